@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "atomic.h"
+#include "device.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <xf86drm.h>
+
+enum plane_prop {
+	PLANE_FB_ID,
+	PLANE_CRTC_ID,
+	PLANE_CRTC_X,
+	PLANE_CRTC_Y,
+	PLANE_CRTC_W,
+	PLANE_CRTC_H,
+	PLANE_SRC_X,
+	PLANE_SRC_Y,
+	PLANE_SRC_W,
+	PLANE_SRC_H,
+	NR_PLANE_PROPS,
+};
+
+static const char *plane_prop_names[NR_PLANE_PROPS] = {
+	"FB_ID", "CRTC_ID",
+	"CRTC_X", "CRTC_Y", "CRTC_W", "CRTC_H",
+	"SRC_X", "SRC_Y", "SRC_W", "SRC_H",
+};
+
+struct atomic {
+	int fd;
+
+	uint32_t crtc_id;
+	uint32_t conn_id;
+	uint32_t plane_id;
+
+	/* property ids */
+	uint32_t conn_crtc_id;
+	uint32_t crtc_mode_id;
+	uint32_t crtc_active;
+	uint32_t plane[NR_PLANE_PROPS];
+	uint32_t plane_zpos;	/* optional */
+
+	uint32_t mode_blob;
+	int64_t zpos;		/* -1 leaves it to the driver */
+};
+
+/* property id by name, 0 if the object doesn't have it */
+static uint32_t
+find_prop(int fd, uint32_t id, uint32_t type, const char *name, uint64_t *value)
+{
+	drmModeObjectProperties *props;
+	drmModePropertyRes *prop;
+	uint32_t i, prop_id = 0;
+
+	props = drmModeObjectGetProperties(fd, id, type);
+	if (!props)
+		return 0;
+
+	for (i = 0; i < props->count_props && !prop_id; i++) {
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+
+		if (strcmp(prop->name, name) == 0) {
+			prop_id = prop->prop_id;
+			if (value)
+				*value = props->prop_values[i];
+		}
+
+		drmModeFreeProperty(prop);
+	}
+
+	drmModeFreeObjectProperties(props);
+
+	return prop_id;
+}
+
+/* without the type property only overlays are listed, universal planes are off */
+bool
+atomic_plane_is_overlay(int fd, uint32_t plane_id)
+{
+	uint64_t type;
+
+	return !find_prop(fd, plane_id, DRM_MODE_OBJECT_PLANE, "type", &type) ||
+		type == DRM_PLANE_TYPE_OVERLAY;
+}
+
+static uint32_t
+find_primary_plane(int fd, uint32_t crtc_id)
+{
+	drmModeRes *resources;
+	drmModePlaneRes *planes;
+	drmModePlane *plane;
+	uint32_t i, plane_id = 0;
+	uint64_t type;
+	int crtc_index = -1;
+
+	resources = drmModeGetResources(fd);
+	if (!resources)
+		return 0;
+
+	for (i = 0; i < (uint32_t) resources->count_crtcs; i++)
+		if (resources->crtcs[i] == crtc_id)
+			crtc_index = i;
+
+	drmModeFreeResources(resources);
+
+	if (crtc_index < 0)
+		return 0;
+
+	planes = drmModeGetPlaneResources(fd);
+	if (!planes)
+		return 0;
+
+	for (i = 0; i < planes->count_planes && !plane_id; i++) {
+		plane = drmModeGetPlane(fd, planes->planes[i]);
+		if (!plane)
+			continue;
+
+		if ((plane->possible_crtcs & (1 << crtc_index)) &&
+				find_prop(fd, plane->plane_id, DRM_MODE_OBJECT_PLANE, "type", &type) &&
+				type == DRM_PLANE_TYPE_PRIMARY)
+			plane_id = plane->plane_id;
+
+		drmModeFreePlane(plane);
+	}
+
+	drmModeFreePlaneResources(planes);
+
+	return plane_id;
+}
+
+/* also exposes the primary and cursor planes */
+bool
+atomic_enable(struct device *dev)
+{
+	return device_set_client_cap(dev, DRM_CLIENT_CAP_ATOMIC, 1) == 0;
+}
+
+struct atomic *
+atomic_new(int fd, uint32_t crtc_id, uint32_t conn_id, uint32_t plane_id)
+{
+	struct atomic *a;
+	unsigned int i;
+
+	if (!plane_id)
+		plane_id = find_primary_plane(fd, crtc_id);
+
+	if (!plane_id) {
+		fprintf(stderr, "no primary plane for crtc %u\n", crtc_id);
+		return NULL;
+	}
+
+	a = g_new0(struct atomic, 1);
+
+	a->fd = fd;
+	a->crtc_id = crtc_id;
+	a->conn_id = conn_id;
+	a->plane_id = plane_id;
+	a->zpos = -1;
+
+	for (i = 0; i < NR_PLANE_PROPS; i++) {
+		a->plane[i] = find_prop(fd, plane_id, DRM_MODE_OBJECT_PLANE, plane_prop_names[i], NULL);
+		if (!a->plane[i])
+			goto missing;
+	}
+
+	a->plane_zpos = find_prop(fd, plane_id, DRM_MODE_OBJECT_PLANE, "zpos", NULL);
+
+	/* only needed for modesets */
+	if (conn_id) {
+		a->conn_crtc_id = find_prop(fd, conn_id, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID", NULL);
+		a->crtc_mode_id = find_prop(fd, crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID", NULL);
+		a->crtc_active = find_prop(fd, crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE", NULL);
+		if (!a->conn_crtc_id || !a->crtc_mode_id || !a->crtc_active)
+			goto missing;
+	}
+
+	return a;
+
+missing:
+	fprintf(stderr, "missing atomic properties\n");
+	g_free(a);
+	return NULL;
+}
+
+void
+atomic_free(struct atomic *a)
+{
+	if (a->mode_blob)
+		drmModeDestroyPropertyBlob(a->fd, a->mode_blob);
+
+	g_free(a);
+}
+
+/* stacking order for the following commits, false when it's fixed */
+bool
+atomic_set_zpos(struct atomic *a, uint64_t zpos)
+{
+	if (!a->plane_zpos)
+		return false;
+
+	a->zpos = zpos;
+
+	return true;
+}
+
+static void
+add_plane(struct atomic *a, drmModeAtomicReq *req, const struct atomic_plane *plane)
+{
+	uint32_t id = a->plane_id;
+
+	/* off: no framebuffer and no crtc */
+	if (!plane->fb) {
+		drmModeAtomicAddProperty(req, id, a->plane[PLANE_FB_ID], 0);
+		drmModeAtomicAddProperty(req, id, a->plane[PLANE_CRTC_ID], 0);
+		return;
+	}
+
+	if (a->zpos >= 0)
+		drmModeAtomicAddProperty(req, id, a->plane_zpos, a->zpos);
+
+	drmModeAtomicAddProperty(req, id, a->plane[PLANE_FB_ID], plane->fb);
+	drmModeAtomicAddProperty(req, id, a->plane[PLANE_CRTC_ID], a->crtc_id);
+	drmModeAtomicAddProperty(req, id, a->plane[PLANE_CRTC_X], (uint64_t) (int64_t) plane->crtc_x);
+	drmModeAtomicAddProperty(req, id, a->plane[PLANE_CRTC_Y], (uint64_t) (int64_t) plane->crtc_y);
+	drmModeAtomicAddProperty(req, id, a->plane[PLANE_CRTC_W], plane->crtc_w);
+	drmModeAtomicAddProperty(req, id, a->plane[PLANE_CRTC_H], plane->crtc_h);
+	drmModeAtomicAddProperty(req, id, a->plane[PLANE_SRC_X], plane->src_x);
+	drmModeAtomicAddProperty(req, id, a->plane[PLANE_SRC_Y], plane->src_y);
+	drmModeAtomicAddProperty(req, id, a->plane[PLANE_SRC_W], plane->src_w);
+	drmModeAtomicAddProperty(req, id, a->plane[PLANE_SRC_H], plane->src_h);
+}
+
+/* connector, crtc and plane in one commit; always allowed to modeset */
+/*
+ * The same mode on every crtc, each with its connector and primary plane,
+ * in a single request: it is checked as a whole first, so either all of
+ * them change or none does.
+ */
+int
+atomic_modeset(struct atomic *const *a, const drmModeModeInfo *mode,
+		const struct atomic_plane *planes, unsigned int count)
+{
+	drmModeAtomicReq *req;
+	uint32_t blobs[count];
+	unsigned int i, n;
+	int ret = 0;
+
+	for (i = 0; i < count; i++)
+		if (!a[i]->conn_id)
+			return -EINVAL;
+
+	/* one blob each, every crtc holds on to its own */
+	for (n = 0; n < count && !ret; n++)
+		ret = drmModeCreatePropertyBlob(a[n]->fd, mode, sizeof(*mode), &blobs[n]);
+	if (ret) {
+		n--;
+		goto out;
+	}
+
+	req = drmModeAtomicAlloc();
+	if (!req) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		drmModeAtomicAddProperty(req, a[i]->conn_id, a[i]->conn_crtc_id, a[i]->crtc_id);
+		drmModeAtomicAddProperty(req, a[i]->crtc_id, a[i]->crtc_mode_id, blobs[i]);
+		drmModeAtomicAddProperty(req, a[i]->crtc_id, a[i]->crtc_active, 1);
+		add_plane(a[i], req, &planes[i]);
+	}
+
+	ret = drmModeAtomicCommit(a[0]->fd, req,
+			DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
+	if (!ret)
+		ret = drmModeAtomicCommit(a[0]->fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
+	drmModeAtomicFree(req);
+
+	if (ret)
+		goto out;
+
+	/* the crtcs keep a reference to the blobs while the mode is in use */
+	for (i = 0; i < count; i++) {
+		if (a[i]->mode_blob)
+			drmModeDestroyPropertyBlob(a[i]->fd, a[i]->mode_blob);
+		a[i]->mode_blob = blobs[i];
+	}
+
+	return 0;
+
+out:
+	for (i = 0; i < n; i++)
+		drmModeDestroyPropertyBlob(a[i]->fd, blobs[i]);
+	return ret;
+}
+
+int
+atomic_flip(struct atomic *a, const struct atomic_plane *plane,
+		uint32_t flags, void *data)
+{
+	drmModeAtomicReq *req;
+	int ret;
+
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return -ENOMEM;
+
+	add_plane(a, req, plane);
+
+	ret = drmModeAtomicCommit(a->fd, req, flags, data);
+	drmModeAtomicFree(req);
+
+	return ret;
+}
+
+/*
+ * Several planes in one commit, each on the crtc of its atomic state: the
+ * overlays of one crtc, or the primary planes of several crtcs showing one
+ * framebuffer. Each crtc takes its planes at its own next vblank and sends
+ * its own flip event.
+ */
+int
+atomic_commit(struct atomic *const *a, const struct atomic_plane *planes,
+		unsigned int count, uint32_t flags, void *data)
+{
+	drmModeAtomicReq *req;
+	unsigned int i;
+	int ret;
+
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++)
+		add_plane(a[i], req, &planes[i]);
+
+	ret = drmModeAtomicCommit(a[0]->fd, req, flags, data);
+	drmModeAtomicFree(req);
+
+	return ret;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <xf86drmMode.h>
+
+enum drm_backend {
+	BACKEND_AUTO,		/* atomic when the driver has it */
+	BACKEND_LEGACY,
+	BACKEND_ATOMIC,
+};
+
+/* what a plane scans out and where, source in 16.16 fixed point; no fb turns it off */
+struct atomic_plane {
+	uint32_t fb;
+	int32_t crtc_x, crtc_y;
+	uint32_t crtc_w, crtc_h;
+	uint32_t src_x, src_y;
+	uint32_t src_w, src_h;
+};
+
+struct atomic;
+struct device;
+
+bool atomic_enable(struct device *dev);
+bool atomic_plane_is_overlay(int fd, uint32_t plane_id);
+
+/* a plane id of 0 picks the primary plane of the crtc */
+struct atomic *atomic_new(int fd, uint32_t crtc_id, uint32_t conn_id, uint32_t plane_id);
+void atomic_free(struct atomic *a);
+bool atomic_set_zpos(struct atomic *a, uint64_t zpos);
+
+/* return 0 or a negative errno, like libdrm */
+int atomic_modeset(struct atomic *const *a, const drmModeModeInfo *mode,
+		const struct atomic_plane *planes, unsigned int count);
+int atomic_flip(struct atomic *a, const struct atomic_plane *plane,
+		uint32_t flags, void *data);
+int atomic_commit(struct atomic *const *a, const struct atomic_plane *planes,
+		unsigned int count, uint32_t flags, void *data);
+
+#endif /* ATOMIC_H */
@@ -0,0 +1,538 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+/*
+ * Benchmark of the render hot path, one JSON object per line.
+ *
+ * The upload suite runs in process and needs no DRM device: it feeds
+ * synthetic frames through the same upload, conversion and damage code the
+ * sinks use, into buffers laid out like scanout buffers. The sink suite
+ * drives the real elements through their sink pad on a device such as
+ * vkms or the in-memory one, so the numbers include the modesetting calls
+ * and vblank pacing.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "format.h"
+#include "convert.h"
+#include "copy.h"
+#include "upload.h"
+#include "damage.h"
+
+#define ROUND_UP(num, scale) (((num) + ((scale) - 1)) & ~((scale) - 1))
+
+#define WARMUP_FRAMES	10
+#define NR_SOURCES	2
+#define NR_TARGETS	3
+
+static const struct {
+	uint32_t width;
+	uint32_t height;
+} sizes[] = {
+	{ 640, 480 },
+	{ 1280, 720 },
+	{ 1920, 1080 },
+	{ 3840, 2160 },
+};
+
+/* pitch alignments of the scanout buffers, 0 for tightly packed */
+static const uint32_t aligns[] = { 0, 64, 256 };
+
+static struct {
+	unsigned int frames;
+	unsigned int threads;
+	const char *suite;
+	const char *device;
+	int conn;
+	int crtc;
+	int plane;
+} opts = {
+	.frames = 100,
+	.threads = 4,
+	.suite = "all",
+};
+
+struct result {
+	const char *suite;
+	const char *name;	/* kernel or element */
+	const struct format *format;
+	const struct format *scanout;	/* NULL when the sink picks it */
+	uint32_t width;
+	uint32_t height;
+	uint32_t align;
+	unsigned int threads;
+	unsigned int buffers;
+	bool damage;
+
+	gint64 *times;		/* usec per frame */
+	unsigned int count;
+	gint64 total;
+	guint64 bytes;
+};
+
+static const char *
+format_name(const struct format *format)
+{
+	static char names[2][5];
+	static unsigned int n;
+	char *name;
+
+	if (!format->fourcc)
+		return "xRGB";
+
+	name = names[n++ % 2];
+	snprintf(name, 5, "%" GST_FOURCC_FORMAT, GST_FOURCC_ARGS(format->fourcc));
+
+	return name;
+}
+
+static int
+cmp_time(const void *a, const void *b)
+{
+	gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static gint64
+percentile(const struct result *r, unsigned int pct)
+{
+	unsigned int i;
+
+	if (!r->count)
+		return 0;
+
+	i = (r->count * pct + 99) / 100;
+
+	return r->times[MIN(MAX(i, 1), r->count) - 1];
+}
+
+static void
+print_result(struct result *r)
+{
+	double secs = MAX(r->total, 1) / 1e6;
+
+	qsort(r->times, r->count, sizeof(*r->times), cmp_time);
+
+	printf("{\"suite\":\"%s\",\"name\":\"%s\",\"format\":\"%s\",\"scanout\":\"%s\","
+			"\"width\":%u,\"height\":%u,\"align\":%u,\"threads\":%u,\"buffers\":%u,"
+			"\"damage\":%s,\"frames\":%u,\"fps\":%.1f,\"mbps\":%.1f,"
+			"\"p50_us\":%" G_GINT64_FORMAT ",\"p95_us\":%" G_GINT64_FORMAT ",\"p99_us\":%" G_GINT64_FORMAT "}\n",
+			r->suite, r->name, format_name(r->format),
+			r->scanout ? format_name(r->scanout) : "auto",
+			r->width, r->height, r->align, r->threads, r->buffers,
+			r->damage ? "true" : "false", r->count,
+			r->count / secs, r->bytes / secs / 1e6,
+			percentile(r, 50), percentile(r, 95), percentile(r, 99));
+	fflush(stdout);
+}
+
+/* xorshift, enough to defeat any compression or zero page tricks */
+static void
+fill_random(uint8_t *p, size_t size, uint32_t seed)
+{
+	uint32_t x = seed | 1;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		p[i] = x;
+	}
+}
+
+static void *
+alloc_frame(size_t size)
+{
+	void *p;
+
+	if (posix_memalign(&p, 4096, ROUND_UP(size, 4096))) {
+		perror("failed posix_memalign()");
+		exit(1);
+	}
+
+	return p;
+}
+
+/* damage runs change one band of 1/8 of the frame per frame */
+static void
+touch_band(uint8_t *data, const struct layout *src, uint32_t height, unsigned int frame)
+{
+	uint32_t band = MAX(height / 8, 1), first = (frame * band) % height;
+	uint32_t last = MIN(first + band, height), r0, r1, y;
+	unsigned int i;
+
+	for (i = 0; i < src->planes; i++) {
+		r0 = (uint64_t) first * src->rows[i] / height;
+		r1 = (uint64_t) last * src->rows[i] / height;
+		for (y = r0; y < r1; y++)
+			data[src->offset[i] + y * src->pitch[i]] ^= 0x5a;
+	}
+}
+
+static void
+bench_upload(const struct format *format, bool convert, uint32_t width, uint32_t height,
+		uint32_t align, unsigned int threads, bool use_damage)
+{
+	const struct format *scanout = convert ? &formats[0] : format;
+	struct layout src, dst;
+	struct upload *upload;
+	struct damage *damage = NULL;
+	uint8_t *sources[NR_SOURCES], *targets[NR_TARGETS];
+	uint32_t bo_width, bo_height, pitch;
+	unsigned int i, n, total = WARMUP_FRAMES + opts.frames;
+	gint64 start, t;
+
+	struct result r = {
+		.suite = "upload",
+		.name = convert ? convert_kernel_name() : copy_kernel_name(),
+		.format = format,
+		.scanout = scanout,
+		.width = width,
+		.height = height,
+		.align = align,
+		.threads = threads,
+		.buffers = NR_TARGETS,
+		.damage = use_damage,
+	};
+
+	format_gst_layout(format, width, height, &src);
+
+	/* the same shape libkms gives us, with the pitch the driver would pick */
+	format_bo_size(scanout, width, height, &bo_width, &bo_height);
+	pitch = align ? ROUND_UP(bo_width * 4, align) : bo_width * 4;
+	format_bo_layout(scanout, width, height, pitch, &dst);
+
+	for (i = 0; i < NR_SOURCES; i++) {
+		sources[i] = alloc_frame(src.size);
+		fill_random(sources[i], src.size, i + 1);
+	}
+
+	for (i = 0; i < NR_TARGETS; i++) {
+		targets[i] = alloc_frame((size_t) pitch * bo_height);
+		memset(targets[i], 0, (size_t) pitch * bo_height);
+	}
+
+	upload = upload_new(threads);
+	if (use_damage)
+		damage = damage_new(height, NR_TARGETS);
+
+	r.times = g_new(gint64, opts.frames);
+
+	for (n = 0; n < total; n++) {
+		uint8_t *data = sources[use_damage ? 0 : n % NR_SOURCES];
+		unsigned int target = n % NR_TARGETS;
+		struct upload_job job = {
+			.format = format,
+			.convert = convert,
+			.src = &src,
+			.data = data,
+			.dst = &dst,
+			.frame = targets[target],
+			.width = width,
+			.height = height,
+		};
+
+		if (use_damage)
+			touch_band(data, &src, height, n);
+
+		start = g_get_monotonic_time();
+
+		if (damage) {
+			damage_scan(damage, &src, data);
+			damage_prepare(damage, target);
+			damage_commit(damage, target);
+			job.dirty = damage->dirty;
+			job.band = DAMAGE_BAND;
+		}
+
+		upload_frame(upload, &job);
+
+		t = g_get_monotonic_time() - start;
+
+		if (n < WARMUP_FRAMES)
+			continue;
+
+		r.times[r.count++] = t;
+		r.total += t;
+		r.bytes += src.size;
+	}
+
+	print_result(&r);
+
+	g_free(r.times);
+	if (damage)
+		damage_free(damage);
+	upload_free(upload);
+
+	for (i = 0; i < NR_TARGETS; i++)
+		free(targets[i]);
+	for (i = 0; i < NR_SOURCES; i++)
+		free(sources[i]);
+}
+
+static void
+suite_upload(void)
+{
+	unsigned int s, f, a, t;
+	unsigned int threads[] = { 1, opts.threads };
+
+	for (s = 0; s < G_N_ELEMENTS(sizes); s++) {
+		for (f = 0; f < nr_formats; f++) {
+			const struct format *format = &formats[f];
+
+			for (a = 0; a < G_N_ELEMENTS(aligns); a++) {
+				for (t = 0; t < G_N_ELEMENTS(threads); t++) {
+					if (t && threads[t] == threads[0])
+						continue;
+
+					bench_upload(format, false, sizes[s].width, sizes[s].height,
+							aligns[a], threads[t], false);
+
+					if (convert_supported(format))
+						bench_upload(format, true, sizes[s].width, sizes[s].height,
+								aligns[a], threads[t], false);
+				}
+			}
+
+			/* mostly static content, the pitch doesn't matter here */
+			bench_upload(format, false, sizes[s].width, sizes[s].height,
+					64, 1, true);
+		}
+	}
+}
+
+static GstCaps *
+fixed_caps(const struct format *format, uint32_t width, uint32_t height)
+{
+	GstStructure *structure;
+
+	structure = format_to_structure(format, FORMAT_MAX_FRAMERATE);
+	gst_structure_set(structure,
+			"width", G_TYPE_INT, width,
+			"height", G_TYPE_INT, height,
+			"framerate", GST_TYPE_FRACTION, 0, 1,
+			NULL);
+
+	return gst_caps_new_full(structure, NULL);
+}
+
+static void
+bench_sink(const char *element, const struct format *format,
+		uint32_t width, uint32_t height, unsigned int buffers, unsigned int threads)
+{
+	GstElement *pipeline, *sink;
+	GstPad *pad;
+	GstCaps *caps;
+	GstBuffer *sources[NR_SOURCES];
+	struct layout src;
+	unsigned int i, n, total = WARMUP_FRAMES + opts.frames;
+	gint64 start, t;
+
+	struct result r = {
+		.suite = "sink",
+		.name = element,
+		.format = format,
+		/* whether a YUV format is converted is up to the plane, "auto" */
+		.scanout = convert_supported(format) ? NULL : format,
+		.width = width,
+		.height = height,
+		.threads = threads,
+		.buffers = buffers,
+	};
+
+	sink = gst_element_factory_make(element, NULL);
+	if (!sink) {
+		fprintf(stderr, "no %s element, run from the build directory\n", element);
+		return;
+	}
+
+	g_object_set(sink,
+			"device", opts.device,
+			"buffers", buffers,
+			"upload-threads", threads,
+			"stats-interval", 0,
+			"sync", FALSE,
+			"async", FALSE,
+			"qos", FALSE,
+			NULL);
+
+	/* the same mode every run, not whatever was left on screen */
+	if (!strcmp(element, "drmsink"))
+		g_object_set(sink, "conn", opts.conn, "crtc", opts.crtc, "mode", "preferred", NULL);
+	else
+		g_object_set(sink, "plane", opts.plane, "crtc", opts.crtc, NULL);
+
+	pipeline = gst_pipeline_new(NULL);
+	gst_bin_add(GST_BIN(pipeline), sink);
+
+	if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+		fprintf(stderr, "%s failed to start\n", element);
+		gst_object_unref(pipeline);
+		return;
+	}
+
+	pad = gst_element_get_static_pad(sink, "sink");
+	caps = fixed_caps(format, width, height);
+	format_gst_layout(format, width, height, &src);
+
+	for (i = 0; i < NR_SOURCES; i++) {
+		sources[i] = gst_buffer_new_and_alloc(src.size);
+		fill_random(GST_BUFFER_DATA(sources[i]), src.size, i + 1);
+		gst_buffer_set_caps(sources[i], caps);
+	}
+
+	gst_pad_send_event(pad, gst_event_new_new_segment(FALSE, 1.0, GST_FORMAT_TIME, 0, -1, 0));
+
+	r.times = g_new(gint64, opts.frames);
+
+	for (n = 0; n < total; n++) {
+		GstFlowReturn ret;
+
+		start = g_get_monotonic_time();
+		ret = gst_pad_chain(pad, gst_buffer_ref(sources[n % NR_SOURCES]));
+		t = g_get_monotonic_time() - start;
+
+		if (ret != GST_FLOW_OK) {
+			fprintf(stderr, "%s: %s\n", element, gst_flow_get_name(ret));
+			break;
+		}
+
+		if (n < WARMUP_FRAMES)
+			continue;
+
+		r.times[r.count++] = t;
+		r.total += t;
+		r.bytes += src.size;
+	}
+
+	if (r.count)
+		print_result(&r);
+
+	g_free(r.times);
+
+	for (i = 0; i < NR_SOURCES; i++)
+		gst_buffer_unref(sources[i]);
+
+	gst_caps_unref(caps);
+	gst_object_unref(pad);
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(pipeline);
+}
+
+static void
+suite_sink(void)
+{
+	static const char *elements[] = { "drmsink", "drmplanesink" };
+	static const unsigned int buffers[] = { 2, 3 };
+	unsigned int e, s, f, b;
+
+	if (!opts.device) {
+		fprintf(stderr, "sink suite skipped, no --device\n");
+		return;
+	}
+
+	if (!gst_plugin_load_file("./libgstdrmsink.so", NULL) ||
+			!gst_plugin_load_file("./libgstdrmplanesink.so", NULL))
+		fprintf(stderr, "couldn't load the plugins from the build directory\n");
+
+	for (e = 0; e < G_N_ELEMENTS(elements); e++) {
+		/* drmplanesink needs a plane */
+		if (e == 1 && !opts.plane)
+			continue;
+
+		for (s = 0; s < G_N_ELEMENTS(sizes); s++)
+			for (f = 0; f < nr_formats; f++)
+				for (b = 0; b < G_N_ELEMENTS(buffers); b++)
+					bench_sink(elements[e], &formats[f], sizes[s].width, sizes[s].height,
+							buffers[b], opts.threads);
+	}
+}
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr,
+			"usage: %s [options]\n"
+			"  --suite upload|sink|all  what to run (all)\n"
+			"  --frames N               frames per run (100)\n"
+			"  --threads N              upload threads besides 1 (4)\n"
+			"  --device PATH            DRM device for the sink suite, e.g. vkms or\n"
+			"                           memory (conn 12, crtc 10, plane 13)\n"
+			"  --conn ID --crtc ID      drmsink output\n"
+			"  --plane ID               drmplanesink plane\n",
+			name);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{ "suite", required_argument, NULL, 's' },
+		{ "frames", required_argument, NULL, 'f' },
+		{ "threads", required_argument, NULL, 't' },
+		{ "device", required_argument, NULL, 'd' },
+		{ "conn", required_argument, NULL, 'c' },
+		{ "crtc", required_argument, NULL, 'r' },
+		{ "plane", required_argument, NULL, 'p' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	int c;
+
+	while ((c = getopt_long(argc, argv, "s:f:t:d:c:r:p:h", options, NULL)) != -1) {
+		switch (c) {
+		case 's':
+			opts.suite = optarg;
+			break;
+		case 'f':
+			opts.frames = MAX(atoi(optarg), 1);
+			break;
+		case 't':
+			opts.threads = CLAMP(atoi(optarg), 1, UPLOAD_MAX_THREADS);
+			break;
+		case 'd':
+			opts.device = optarg;
+			break;
+		case 'c':
+			opts.conn = atoi(optarg);
+			break;
+		case 'r':
+			opts.crtc = atoi(optarg);
+			break;
+		case 'p':
+			opts.plane = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	gst_init(&argc, &argv);
+
+	convert_init();
+	copy_init();
+
+	if (!strcmp(opts.suite, "upload") || !strcmp(opts.suite, "all"))
+		suite_upload();
+
+	if (!strcmp(opts.suite, "sink") || !strcmp(opts.suite, "all"))
+		suite_sink();
+
+	return 0;
+}
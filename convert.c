@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "convert.h"
+#include "format.h"
+
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+/*
+ * 6 bit fixed point coefficients; every kernel must produce exactly the
+ * same output as the scalar reference.
+ */
+#define CY	74
+#define CRV	102
+#define CGV	52
+#define CGU	25
+#define CBU	129
+#define YBIAS	(16 * CY - 32)	/* also rounds the final shift */
+
+typedef void (*i420_row_func)(uint8_t *dst, const uint8_t *y,
+		const uint8_t *u, const uint8_t *v, uint32_t width);
+typedef void (*nv12_row_func)(uint8_t *dst, const uint8_t *y,
+		const uint8_t *uv, uint32_t width);
+
+struct kernels {
+	const char *name;
+	i420_row_func i420;
+	nv12_row_func nv12;
+};
+
+static inline uint8_t
+clamp(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static inline void
+pixel(uint8_t *dst, int y, int u, int v)
+{
+	int yy = y * CY - YBIAS;
+
+	u -= 128;
+	v -= 128;
+
+	dst[0] = clamp((yy + CBU * u) >> 6);
+	dst[1] = clamp((yy - CGV * v - CGU * u) >> 6);
+	dst[2] = clamp((yy + CRV * v) >> 6);
+	dst[3] = 0xff;
+}
+
+static void
+i420_row_c(uint8_t *dst, const uint8_t *y,
+		const uint8_t *u, const uint8_t *v, uint32_t width)
+{
+	uint32_t x;
+
+	for (x = 0; x < width; x++)
+		pixel(dst + 4 * x, y[x], u[x / 2], v[x / 2]);
+}
+
+static void
+nv12_row_c(uint8_t *dst, const uint8_t *y,
+		const uint8_t *uv, uint32_t width)
+{
+	uint32_t x;
+
+	for (x = 0; x < width; x++)
+		pixel(dst + 4 * x, y[x], uv[x & ~1], uv[x | 1]);
+}
+
+#if defined(__SSE2__)
+
+/* 8 pixels, u and v already widened and duplicated to one per pixel */
+static inline void
+sse2_pixels(uint8_t *dst, __m128i y, __m128i u, __m128i v)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i yy, r, g, b, bg, rx;
+
+	yy = _mm_sub_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(y, zero), _mm_set1_epi16(CY)),
+			_mm_set1_epi16(YBIAS));
+	u = _mm_sub_epi16(u, _mm_set1_epi16(128));
+	v = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+	r = _mm_adds_epi16(yy, _mm_mullo_epi16(v, _mm_set1_epi16(CRV)));
+	g = _mm_subs_epi16(yy, _mm_mullo_epi16(v, _mm_set1_epi16(CGV)));
+	g = _mm_subs_epi16(g, _mm_mullo_epi16(u, _mm_set1_epi16(CGU)));
+	b = _mm_adds_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(CBU)));
+
+	r = _mm_packus_epi16(_mm_srai_epi16(r, 6), zero);
+	g = _mm_packus_epi16(_mm_srai_epi16(g, 6), zero);
+	b = _mm_packus_epi16(_mm_srai_epi16(b, 6), zero);
+
+	bg = _mm_unpacklo_epi8(b, g);
+	rx = _mm_unpacklo_epi8(r, _mm_set1_epi8(-1));
+
+	_mm_storeu_si128((__m128i *) dst, _mm_unpacklo_epi16(bg, rx));
+	_mm_storeu_si128((__m128i *) (dst + 16), _mm_unpackhi_epi16(bg, rx));
+}
+
+static void
+i420_row_sse2(uint8_t *dst, const uint8_t *y,
+		const uint8_t *u, const uint8_t *v, uint32_t width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint32_t x, u4, v4;
+	__m128i uu, vv;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		memcpy(&u4, u + x / 2, 4);
+		memcpy(&v4, v + x / 2, 4);
+
+		uu = _mm_unpacklo_epi8(_mm_cvtsi32_si128(u4), zero);
+		vv = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v4), zero);
+
+		sse2_pixels(dst + 4 * x, _mm_loadl_epi64((const __m128i *) (y + x)),
+				_mm_unpacklo_epi16(uu, uu), _mm_unpacklo_epi16(vv, vv));
+	}
+
+	i420_row_c(dst + 4 * x, y + x, u + x / 2, v + x / 2, width - x);
+}
+
+static void
+nv12_row_sse2(uint8_t *dst, const uint8_t *y,
+		const uint8_t *uv, uint32_t width)
+{
+	uint32_t x;
+	__m128i c, uu, vv;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		c = _mm_loadl_epi64((const __m128i *) (uv + x));
+
+		uu = _mm_and_si128(c, _mm_set1_epi16(0xff));
+		vv = _mm_srli_epi16(c, 8);
+
+		sse2_pixels(dst + 4 * x, _mm_loadl_epi64((const __m128i *) (y + x)),
+				_mm_unpacklo_epi16(uu, uu), _mm_unpacklo_epi16(vv, vv));
+	}
+
+	nv12_row_c(dst + 4 * x, y + x, uv + x, width - x);
+}
+
+#endif
+
+#ifdef HAVE_AVX2
+
+/* 16 pixels, u and v are 8 widened samples each */
+__attribute__((target("avx2")))
+static inline void
+avx2_pixels(uint8_t *dst, __m128i y, __m128i u, __m128i v)
+{
+	__m256i yy, uu, vv, r, g, b, bg, rx, lo, hi;
+
+	uu = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(u, u)),
+			_mm_unpackhi_epi16(u, u), 1);
+	vv = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(v, v)),
+			_mm_unpackhi_epi16(v, v), 1);
+
+	yy = _mm256_sub_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(y), _mm256_set1_epi16(CY)),
+			_mm256_set1_epi16(YBIAS));
+	uu = _mm256_sub_epi16(uu, _mm256_set1_epi16(128));
+	vv = _mm256_sub_epi16(vv, _mm256_set1_epi16(128));
+
+	r = _mm256_adds_epi16(yy, _mm256_mullo_epi16(vv, _mm256_set1_epi16(CRV)));
+	g = _mm256_subs_epi16(yy, _mm256_mullo_epi16(vv, _mm256_set1_epi16(CGV)));
+	g = _mm256_subs_epi16(g, _mm256_mullo_epi16(uu, _mm256_set1_epi16(CGU)));
+	b = _mm256_adds_epi16(yy, _mm256_mullo_epi16(uu, _mm256_set1_epi16(CBU)));
+
+	/* packing and unpacking stay within 128 bit lanes: pixels 0-7 | 8-15 */
+	r = _mm256_packus_epi16(_mm256_srai_epi16(r, 6), _mm256_srai_epi16(r, 6));
+	g = _mm256_packus_epi16(_mm256_srai_epi16(g, 6), _mm256_srai_epi16(g, 6));
+	b = _mm256_packus_epi16(_mm256_srai_epi16(b, 6), _mm256_srai_epi16(b, 6));
+
+	bg = _mm256_unpacklo_epi8(b, g);
+	rx = _mm256_unpacklo_epi8(r, _mm256_set1_epi8(-1));
+
+	lo = _mm256_unpacklo_epi16(bg, rx);	/* pixels 0-3 | 8-11 */
+	hi = _mm256_unpackhi_epi16(bg, rx);	/* pixels 4-7 | 12-15 */
+
+	_mm256_storeu_si256((__m256i *) dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+	_mm256_storeu_si256((__m256i *) (dst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+__attribute__((target("avx2")))
+static void
+i420_row_avx2(uint8_t *dst, const uint8_t *y,
+		const uint8_t *u, const uint8_t *v, uint32_t width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16)
+		avx2_pixels(dst + 4 * x, _mm_loadu_si128((const __m128i *) (y + x)),
+				_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (u + x / 2)), zero),
+				_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (v + x / 2)), zero));
+
+	i420_row_c(dst + 4 * x, y + x, u + x / 2, v + x / 2, width - x);
+}
+
+__attribute__((target("avx2")))
+static void
+nv12_row_avx2(uint8_t *dst, const uint8_t *y,
+		const uint8_t *uv, uint32_t width)
+{
+	uint32_t x;
+	__m128i c;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		c = _mm_loadu_si128((const __m128i *) (uv + x));
+		avx2_pixels(dst + 4 * x, _mm_loadu_si128((const __m128i *) (y + x)),
+				_mm_and_si128(c, _mm_set1_epi16(0xff)), _mm_srli_epi16(c, 8));
+	}
+
+	nv12_row_c(dst + 4 * x, y + x, uv + x, width - x);
+}
+
+#endif
+
+#ifdef HAVE_NEON
+
+/* 8 pixels, u and v already duplicated to one sample per pixel */
+static inline void
+neon_pixels(uint8_t *dst, uint8x8_t y, uint8x8_t u, uint8x8_t v)
+{
+	int16x8_t yy, uu, vv, r, g, b;
+	uint8x8x4_t out;
+
+	yy = vsubq_s16(vreinterpretq_s16_u16(vmull_u8(y, vdup_n_u8(CY))), vdupq_n_s16(YBIAS));
+	uu = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u)), vdupq_n_s16(128));
+	vv = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v)), vdupq_n_s16(128));
+
+	r = vqaddq_s16(yy, vmulq_n_s16(vv, CRV));
+	g = vqsubq_s16(yy, vmulq_n_s16(vv, CGV));
+	g = vqsubq_s16(g, vmulq_n_s16(uu, CGU));
+	b = vqaddq_s16(yy, vmulq_n_s16(uu, CBU));
+
+	out.val[0] = vqshrun_n_s16(b, 6);
+	out.val[1] = vqshrun_n_s16(g, 6);
+	out.val[2] = vqshrun_n_s16(r, 6);
+	out.val[3] = vdup_n_u8(0xff);
+
+	vst4_u8(dst, out);
+}
+
+static void
+i420_row_neon(uint8_t *dst, const uint8_t *y,
+		const uint8_t *u, const uint8_t *v, uint32_t width)
+{
+	uint8x8x2_t uu, vv;
+	uint8x16_t yy;
+	uint32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		yy = vld1q_u8(y + x);
+		uu = vzip_u8(vld1_u8(u + x / 2), vld1_u8(u + x / 2));
+		vv = vzip_u8(vld1_u8(v + x / 2), vld1_u8(v + x / 2));
+
+		neon_pixels(dst + 4 * x, vget_low_u8(yy), uu.val[0], vv.val[0]);
+		neon_pixels(dst + 4 * x + 32, vget_high_u8(yy), uu.val[1], vv.val[1]);
+	}
+
+	i420_row_c(dst + 4 * x, y + x, u + x / 2, v + x / 2, width - x);
+}
+
+static void
+nv12_row_neon(uint8_t *dst, const uint8_t *y,
+		const uint8_t *uv, uint32_t width)
+{
+	uint8x8x2_t c, uu, vv;
+	uint8x16_t yy;
+	uint32_t x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		yy = vld1q_u8(y + x);
+		c = vld2_u8(uv + x);
+		uu = vzip_u8(c.val[0], c.val[0]);
+		vv = vzip_u8(c.val[1], c.val[1]);
+
+		neon_pixels(dst + 4 * x, vget_low_u8(yy), uu.val[0], vv.val[0]);
+		neon_pixels(dst + 4 * x + 32, vget_high_u8(yy), uu.val[1], vv.val[1]);
+	}
+
+	nv12_row_c(dst + 4 * x, y + x, uv + x, width - x);
+}
+
+#endif
+
+static const struct kernels kernels_c = { "c", i420_row_c, nv12_row_c };
+#if defined(__SSE2__)
+static const struct kernels kernels_sse2 = { "sse2", i420_row_sse2, nv12_row_sse2 };
+#endif
+#ifdef HAVE_AVX2
+static const struct kernels kernels_avx2 = { "avx2", i420_row_avx2, nv12_row_avx2 };
+#endif
+#ifdef HAVE_NEON
+static const struct kernels kernels_neon = { "neon", i420_row_neon, nv12_row_neon };
+#endif
+
+static const struct kernels *kernels = &kernels_c;
+
+void
+convert_init(void)
+{
+#ifdef HAVE_NEON
+	kernels = &kernels_neon;
+#endif
+#if defined(__SSE2__)
+	kernels = &kernels_sse2;
+#endif
+#ifdef HAVE_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		kernels = &kernels_avx2;
+#endif
+}
+
+const char *
+convert_kernel_name(void)
+{
+	return kernels->name;
+}
+
+bool
+convert_supported(const struct format *format)
+{
+	return format->drm_format == DRM_FORMAT_YUV420 ||
+		format->drm_format == DRM_FORMAT_NV12;
+}
+
+void
+convert_rows(const struct format *format,
+		const struct layout *src, const uint8_t *data,
+		uint8_t *dst, uint32_t pitch, uint32_t width,
+		uint32_t first, uint32_t last)
+{
+	const uint8_t *y = data + src->offset[0];
+	const uint8_t *u = data + src->offset[1];
+	const uint8_t *v = data + src->offset[2];
+	uint32_t s;
+
+	for (s = first; s < last; s++) {
+		const uint8_t *yrow = y + s * src->pitch[0];
+		uint8_t *drow = dst + s * pitch;
+
+		if (format->drm_format == DRM_FORMAT_NV12)
+			kernels->nv12(drow, yrow, u + (s / 2) * src->pitch[1], width);
+		else
+			kernels->i420(drow, yrow, u + (s / 2) * src->pitch[1],
+					v + (s / 2) * src->pitch[2], width);
+	}
+}
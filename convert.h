@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct format;
+struct layout;
+
+void convert_init(void);
+const char *convert_kernel_name(void);
+
+bool convert_supported(const struct format *format);
+
+/*
+ * BT.601 limited range YUV to 32bpp xRGB, straight into the scanout buffer.
+ * Converts rows first..last-1; dst points to the first row of the frame.
+ */
+void convert_rows(const struct format *format,
+		const struct layout *src, const uint8_t *data,
+		uint8_t *dst, uint32_t pitch, uint32_t width,
+		uint32_t first, uint32_t last);
+
+#endif /* CONVERT_H */
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "copy.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+/* below this the setup of the vector loops does not pay off */
+#define MIN_VECTOR_COPY	256
+
+typedef void (*copy_func)(uint8_t *dst, const uint8_t *src, size_t n);
+
+struct kernel {
+	const char *name;
+	copy_func copy;
+};
+
+static void
+copy_c(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+#if defined(__SSE2__)
+
+/* streaming stores bypass the cache and fill whole write-combining lines */
+static void
+copy_sse2(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	size_t head;
+	__m128i a, b, c, d;
+
+	if (n < MIN_VECTOR_COPY) {
+		memcpy(dst, src, n);
+		return;
+	}
+
+	head = -(uintptr_t) dst & 15;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	n -= head;
+
+	for (; n >= 64; n -= 64, dst += 64, src += 64) {
+		a = _mm_loadu_si128((const __m128i *) src);
+		b = _mm_loadu_si128((const __m128i *) (src + 16));
+		c = _mm_loadu_si128((const __m128i *) (src + 32));
+		d = _mm_loadu_si128((const __m128i *) (src + 48));
+		_mm_stream_si128((__m128i *) dst, a);
+		_mm_stream_si128((__m128i *) (dst + 16), b);
+		_mm_stream_si128((__m128i *) (dst + 32), c);
+		_mm_stream_si128((__m128i *) (dst + 48), d);
+	}
+
+	_mm_sfence();
+
+	memcpy(dst, src, n);
+}
+
+#endif
+
+#ifdef HAVE_AVX2
+
+__attribute__((target("avx2")))
+static void
+copy_avx2(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	size_t head;
+	__m256i a, b, c, d;
+
+	if (n < MIN_VECTOR_COPY) {
+		memcpy(dst, src, n);
+		return;
+	}
+
+	head = -(uintptr_t) dst & 31;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	n -= head;
+
+	for (; n >= 128; n -= 128, dst += 128, src += 128) {
+		a = _mm256_loadu_si256((const __m256i *) src);
+		b = _mm256_loadu_si256((const __m256i *) (src + 32));
+		c = _mm256_loadu_si256((const __m256i *) (src + 64));
+		d = _mm256_loadu_si256((const __m256i *) (src + 96));
+		_mm256_stream_si256((__m256i *) dst, a);
+		_mm256_stream_si256((__m256i *) (dst + 32), b);
+		_mm256_stream_si256((__m256i *) (dst + 64), c);
+		_mm256_stream_si256((__m256i *) (dst + 96), d);
+	}
+
+	_mm_sfence();
+
+	memcpy(dst, src, n);
+}
+
+#endif
+
+#ifdef HAVE_NEON
+
+/* full aligned 64 byte bursts let the write buffer merge whole lines */
+static void
+copy_neon(uint8_t *dst, const uint8_t *src, size_t n)
+{
+	size_t head;
+	uint8x16_t a, b, c, d;
+
+	if (n < MIN_VECTOR_COPY) {
+		memcpy(dst, src, n);
+		return;
+	}
+
+	head = -(uintptr_t) dst & 15;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	n -= head;
+
+	for (; n >= 64; n -= 64, dst += 64, src += 64) {
+		a = vld1q_u8(src);
+		b = vld1q_u8(src + 16);
+		c = vld1q_u8(src + 32);
+		d = vld1q_u8(src + 48);
+		vst1q_u8(dst, a);
+		vst1q_u8(dst + 16, b);
+		vst1q_u8(dst + 32, c);
+		vst1q_u8(dst + 48, d);
+	}
+
+	memcpy(dst, src, n);
+}
+
+#endif
+
+static const struct kernel kernel_c = { "c", copy_c };
+#if defined(__SSE2__)
+static const struct kernel kernel_sse2 = { "sse2", copy_sse2 };
+#endif
+#ifdef HAVE_AVX2
+static const struct kernel kernel_avx2 = { "avx2", copy_avx2 };
+#endif
+#ifdef HAVE_NEON
+static const struct kernel kernel_neon = { "neon", copy_neon };
+#endif
+
+static const struct kernel *kernel = &kernel_c;
+
+void
+copy_init(void)
+{
+#ifdef HAVE_NEON
+	kernel = &kernel_neon;
+#endif
+#if defined(__SSE2__)
+	kernel = &kernel_sse2;
+#endif
+#ifdef HAVE_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		kernel = &kernel_avx2;
+#endif
+}
+
+const char *
+copy_kernel_name(void)
+{
+	return kernel->name;
+}
+
+void
+copy_rows(uint8_t *dst, uint32_t dst_pitch,
+		const uint8_t *src, uint32_t src_pitch,
+		uint32_t row_bytes, uint32_t rows)
+{
+	uint32_t s;
+
+	if (dst_pitch == row_bytes && src_pitch == row_bytes) {
+		kernel->copy(dst, src, (size_t) row_bytes * rows);
+		return;
+	}
+
+	for (s = 0; s < rows; s++)
+		kernel->copy(dst + s * dst_pitch, src + s * src_pitch, row_bytes);
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef COPY_H
+#define COPY_H
+
+#include <stdint.h>
+
+void copy_init(void);
+const char *copy_kernel_name(void);
+
+/*
+ * Copy into write-combined scanout memory. Rows are copied in one go when
+ * both buffers are tightly packed.
+ */
+void copy_rows(uint8_t *dst, uint32_t dst_pitch,
+		const uint8_t *src, uint32_t src_pitch,
+		uint32_t row_bytes, uint32_t rows);
+
+#endif /* COPY_H */
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "damage.h"
+#include "format.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+/* never produced by hash_bytes(), marks content we know nothing about */
+#define HASH_UNKNOWN	0
+
+static uint64_t
+hash_bytes(uint64_t h, const uint8_t *p, uint32_t n)
+{
+	uint64_t v;
+
+	for (; n >= 8; n -= 8, p += 8) {
+		memcpy(&v, p, 8);
+		h = (h ^ v) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+
+	for (; n; n--, p++)
+		h = (h ^ *p) * 0x100000001b3ULL;
+
+	return h;
+}
+
+struct damage *
+damage_new(uint32_t height, unsigned int pages)
+{
+	struct damage *d;
+	unsigned int i;
+
+	d = g_new0(struct damage, 1);
+
+	d->height = height;
+	d->bands = (height + DAMAGE_BAND - 1) / DAMAGE_BAND;
+	d->frame = g_new0(uint64_t, d->bands);
+	d->shown = g_new0(uint64_t, d->bands);
+	d->dirty = g_new0(uint8_t, d->bands);
+
+	for (i = 0; i < pages && i < RING_MAX_PAGES; i++)
+		d->pages[i] = g_new0(uint64_t, d->bands);
+
+	return d;
+}
+
+void
+damage_free(struct damage *d)
+{
+	unsigned int i;
+
+	for (i = 0; i < RING_MAX_PAGES; i++)
+		g_free(d->pages[i]);
+
+	g_free(d->dirty);
+	g_free(d->shown);
+	g_free(d->frame);
+	g_free(d);
+}
+
+/* hash the incoming frame, false if it is identical to the one shown */
+bool
+damage_scan(struct damage *d, const struct layout *src, const uint8_t *data)
+{
+	bool changed = false;
+	unsigned int i;
+	uint32_t b, s, r0, r1;
+	uint64_t h;
+
+	for (b = 0; b < d->bands; b++) {
+		h = 0xcbf29ce484222325ULL;
+
+		for (i = 0; i < src->planes; i++) {
+			r0 = (uint64_t) b * DAMAGE_BAND * src->rows[i] / d->height;
+			r1 = (uint64_t) MIN((b + 1) * DAMAGE_BAND, d->height) * src->rows[i] / d->height;
+
+			for (s = r0; s < r1; s++)
+				h = hash_bytes(h, data + src->offset[i] + s * src->pitch[i], src->row_bytes[i]);
+		}
+
+		if (h == HASH_UNKNOWN)
+			h = 1;
+
+		d->frame[b] = h;
+		if (h != d->shown[b])
+			changed = true;
+	}
+
+	return changed;
+}
+
+/* mark what the page lacks of the incoming frame, returns the band count */
+unsigned int
+damage_prepare(struct damage *d, unsigned int page)
+{
+	unsigned int count = 0;
+	uint32_t b;
+
+	for (b = 0; b < d->bands; b++) {
+		d->dirty[b] = d->pages[page][b] != d->frame[b];
+		count += d->dirty[b];
+	}
+
+	return count;
+}
+
+/*
+ * Rectangles of what changed on screen, in framebuffer coordinates. Runs
+ * beyond DAMAGE_MAX_CLIPS are merged into the last rectangle.
+ */
+unsigned int
+damage_clips(struct damage *d, drmModeClip *clips,
+		uint32_t x, uint32_t y, uint32_t width)
+{
+	unsigned int n = 0;
+	uint32_t b, first;
+
+	for (b = 0; b < d->bands; b++) {
+		if (d->frame[b] == d->shown[b])
+			continue;
+
+		first = b;
+		while (b + 1 < d->bands && d->frame[b + 1] != d->shown[b + 1])
+			b++;
+
+		if (n == DAMAGE_MAX_CLIPS)
+			n--;
+		else
+			clips[n].y1 = y + first * DAMAGE_BAND;
+
+		clips[n].x1 = x;
+		clips[n].x2 = x + width;
+		clips[n].y2 = y + MIN((b + 1) * DAMAGE_BAND, d->height);
+		n++;
+	}
+
+	return n;
+}
+
+void
+damage_commit(struct damage *d, unsigned int page)
+{
+	memcpy(d->pages[page], d->frame, d->bands * sizeof(*d->frame));
+	memcpy(d->shown, d->frame, d->bands * sizeof(*d->frame));
+}
+
+/* the page was written behind our back, e.g. by upstream */
+void
+damage_invalidate(struct damage *d, unsigned int page)
+{
+	memset(d->pages[page], HASH_UNKNOWN, d->bands * sizeof(*d->frame));
+	damage_invalidate_shown(d);
+}
+
+/* something that isn't one of our pages went on screen */
+void
+damage_invalidate_shown(struct damage *d)
+{
+	memset(d->shown, HASH_UNKNOWN, d->bands * sizeof(*d->frame));
+}
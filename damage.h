@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <xf86drmMode.h>
+
+#include "ring.h"
+
+/* rows per band; two keeps the chroma row of 4:2:0 formats in one band */
+#define DAMAGE_BAND	2
+#define DAMAGE_MAX_CLIPS	16
+
+struct layout;
+
+/*
+ * Frames are compared by hashing bands of rows, so no shadow copy of the
+ * frame is needed. Every page remembers the hashes of what it holds, which
+ * is several frames old in a deep ring.
+ */
+struct damage {
+	uint32_t height;
+	uint32_t bands;
+	uint64_t *frame;	/* incoming frame */
+	uint64_t *shown;	/* last frame queued for display */
+	uint64_t *pages[RING_MAX_PAGES];
+	uint8_t *dirty;		/* bands to upload into the target page */
+};
+
+struct damage *damage_new(uint32_t height, unsigned int pages);
+void damage_free(struct damage *d);
+
+bool damage_scan(struct damage *d, const struct layout *src, const uint8_t *data);
+unsigned int damage_prepare(struct damage *d, unsigned int page);
+unsigned int damage_clips(struct damage *d, drmModeClip *clips,
+		uint32_t x, uint32_t y, uint32_t width);
+void damage_commit(struct damage *d, unsigned int page);
+void damage_invalidate(struct damage *d, unsigned int page);
+void damage_invalidate_shown(struct damage *d);
+
+#endif /* DAMAGE_H */
@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "device.h"
+#include "memdev.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <libkms.h>
+
+/* libdrm and libkms */
+
+static int
+drm_open(struct device *dev, const char *path)
+{
+	struct kms_driver *drv;
+
+	/* another sink's thread may read our events, never block in read() */
+	dev->fd = open(path, O_RDWR | O_CLOEXEC | O_NONBLOCK);
+	if (dev->fd < 0) {
+		perror("cannot open drm device");
+		return -1;
+	}
+
+	if (kms_create(dev->fd, &drv)) {
+		perror("failed kms_create()");
+		close(dev->fd);
+		return -1;
+	}
+
+	dev->priv = drv;
+
+	return 0;
+}
+
+static void
+drm_close(struct device *dev)
+{
+	struct kms_driver *drv = dev->priv;
+
+	kms_destroy(&drv);
+	close(dev->fd);
+}
+
+static int
+drm_get_cap(struct device *dev, uint64_t cap, uint64_t *value)
+{
+	return drmGetCap(dev->fd, cap, value);
+}
+
+static int
+drm_set_client_cap(struct device *dev, uint64_t cap, uint64_t value)
+{
+	return drmSetClientCap(dev->fd, cap, value);
+}
+
+static drmModeRes *
+drm_get_resources(struct device *dev)
+{
+	return drmModeGetResources(dev->fd);
+}
+
+static drmModeConnector *
+drm_get_connector(struct device *dev, uint32_t id)
+{
+	return drmModeGetConnector(dev->fd, id);
+}
+
+static drmModeConnector *
+drm_get_connector_current(struct device *dev, uint32_t id)
+{
+	return drmModeGetConnectorCurrent(dev->fd, id);
+}
+
+static drmModeEncoder *
+drm_get_encoder(struct device *dev, uint32_t id)
+{
+	return drmModeGetEncoder(dev->fd, id);
+}
+
+static drmModeCrtc *
+drm_get_crtc(struct device *dev, uint32_t id)
+{
+	return drmModeGetCrtc(dev->fd, id);
+}
+
+static drmModePlaneRes *
+drm_get_plane_resources(struct device *dev)
+{
+	return drmModeGetPlaneResources(dev->fd);
+}
+
+static drmModePlane *
+drm_get_plane(struct device *dev, uint32_t id)
+{
+	return drmModeGetPlane(dev->fd, id);
+}
+
+static int
+drm_set_crtc(struct device *dev, uint32_t crtc_id, uint32_t fb,
+		uint32_t x, uint32_t y, uint32_t *conns, int count,
+		drmModeModeInfo *mode)
+{
+	return drmModeSetCrtc(dev->fd, crtc_id, fb, x, y, conns, count, mode);
+}
+
+static int
+drm_set_plane(struct device *dev, uint32_t plane_id, uint32_t crtc_id,
+		uint32_t fb, uint32_t flags,
+		int32_t crtc_x, int32_t crtc_y, uint32_t crtc_w, uint32_t crtc_h,
+		uint32_t src_x, uint32_t src_y, uint32_t src_w, uint32_t src_h)
+{
+	return drmModeSetPlane(dev->fd, plane_id, crtc_id, fb, flags,
+			crtc_x, crtc_y, crtc_w, crtc_h, src_x, src_y, src_w, src_h);
+}
+
+static int
+drm_page_flip(struct device *dev, uint32_t crtc_id, uint32_t fb,
+		uint32_t flags, void *data)
+{
+	return drmModePageFlip(dev->fd, crtc_id, fb, flags, data);
+}
+
+static int
+drm_dirty_fb(struct device *dev, uint32_t fb, drmModeClip *clips, uint32_t count)
+{
+	return drmModeDirtyFB(dev->fd, fb, clips, count);
+}
+
+static int
+drm_handle_event(struct device *dev, drmEventContext *ctx)
+{
+	return drmHandleEvent(dev->fd, ctx);
+}
+
+static int
+drm_add_fb2(struct device *dev, uint32_t width, uint32_t height,
+		uint32_t format, const uint32_t handles[4], const uint32_t pitches[4],
+		const uint32_t offsets[4], uint32_t *fb, uint32_t flags)
+{
+	return drmModeAddFB2(dev->fd, width, height, format,
+			handles, pitches, offsets, fb, flags);
+}
+
+static int
+drm_rm_fb(struct device *dev, uint32_t fb)
+{
+	return drmModeRmFB(dev->fd, fb);
+}
+
+static void *
+drm_bo_create(struct device *dev, uint32_t width, uint32_t height,
+		uint32_t *handle, uint32_t *pitch, void **map)
+{
+	struct kms_bo *bo;
+
+	uint32_t attr[] = {
+		KMS_WIDTH, width,
+		KMS_HEIGHT, height,
+		KMS_BO_TYPE, KMS_BO_TYPE_SCANOUT_X8R8G8B8,
+		KMS_TERMINATE_PROP_LIST
+	};
+
+	if (kms_bo_create(dev->priv, attr, &bo)) {
+		perror("failed kms_bo_create()");
+		return NULL;
+	}
+
+	if (kms_bo_get_prop(bo, KMS_PITCH, pitch)) {
+		perror("failed kms_bo_get_prop(KMS_PITCH)");
+		goto err_bo;
+	}
+
+	if (kms_bo_get_prop(bo, KMS_HANDLE, handle)) {
+		perror("failed kms_bo_get_prop(KMS_HANDLE)");
+		goto err_bo;
+	}
+
+	if (kms_bo_map(bo, map)) {
+		perror("failed kms_bo_map()");
+		goto err_bo;
+	}
+
+	return bo;
+
+err_bo:
+	kms_bo_destroy(&bo);
+	return NULL;
+}
+
+static void
+drm_bo_destroy(struct device *dev, void *data)
+{
+	struct kms_bo *bo = data;
+
+	kms_bo_unmap(bo);
+	kms_bo_destroy(&bo);
+}
+
+static int
+drm_prime_handle_to_fd(struct device *dev, uint32_t handle, uint32_t flags, int *dmabuf)
+{
+	return drmPrimeHandleToFD(dev->fd, handle, flags, dmabuf);
+}
+
+static const struct device_funcs drm_funcs = {
+	.open = drm_open,
+	.close = drm_close,
+	.get_cap = drm_get_cap,
+	.set_client_cap = drm_set_client_cap,
+	.get_resources = drm_get_resources,
+	.get_connector = drm_get_connector,
+	.get_connector_current = drm_get_connector_current,
+	.get_encoder = drm_get_encoder,
+	.get_crtc = drm_get_crtc,
+	.get_plane_resources = drm_get_plane_resources,
+	.get_plane = drm_get_plane,
+	.set_crtc = drm_set_crtc,
+	.set_plane = drm_set_plane,
+	.page_flip = drm_page_flip,
+	.dirty_fb = drm_dirty_fb,
+	.handle_event = drm_handle_event,
+	.add_fb2 = drm_add_fb2,
+	.rm_fb = drm_rm_fb,
+	.bo_create = drm_bo_create,
+	.bo_destroy = drm_bo_destroy,
+	.prime_handle_to_fd = drm_prime_handle_to_fd,
+};
+
+/* the backend is picked here once, the calls below go straight to it */
+
+/* "memory" with or without options, but not e.g. a file "memory.img" */
+static bool
+memdev_path(const char *path)
+{
+	size_t len = strlen(MEMDEV_PREFIX);
+
+	return strncmp(path, MEMDEV_PREFIX, len) == 0 &&
+		(path[len] == '\0' || path[len] == ':' || path[len] == ',');
+}
+
+struct device *
+device_open(const char *path)
+{
+	struct device *dev;
+
+	dev = g_new0(struct device, 1);
+	dev->fd = -1;
+
+	if (memdev_path(path))
+		dev->funcs = &memdev_funcs;
+	else
+		dev->funcs = &drm_funcs;
+
+	if (dev->funcs->open(dev, path)) {
+		g_free(dev);
+		return NULL;
+	}
+
+	return dev;
+}
+
+void
+device_close(struct device *dev)
+{
+	dev->funcs->close(dev);
+	g_free(dev);
+}
+
+int
+device_get_cap(struct device *dev, uint64_t cap, uint64_t *value)
+{
+	return dev->funcs->get_cap(dev, cap, value);
+}
+
+int
+device_set_client_cap(struct device *dev, uint64_t cap, uint64_t value)
+{
+	return dev->funcs->set_client_cap(dev, cap, value);
+}
+
+drmModeRes *
+device_get_resources(struct device *dev)
+{
+	return dev->funcs->get_resources(dev);
+}
+
+drmModeConnector *
+device_get_connector(struct device *dev, uint32_t id)
+{
+	return dev->funcs->get_connector(dev, id);
+}
+
+drmModeConnector *
+device_get_connector_current(struct device *dev, uint32_t id)
+{
+	return dev->funcs->get_connector_current(dev, id);
+}
+
+drmModeEncoder *
+device_get_encoder(struct device *dev, uint32_t id)
+{
+	return dev->funcs->get_encoder(dev, id);
+}
+
+drmModeCrtc *
+device_get_crtc(struct device *dev, uint32_t id)
+{
+	return dev->funcs->get_crtc(dev, id);
+}
+
+drmModePlaneRes *
+device_get_plane_resources(struct device *dev)
+{
+	return dev->funcs->get_plane_resources(dev);
+}
+
+drmModePlane *
+device_get_plane(struct device *dev, uint32_t id)
+{
+	return dev->funcs->get_plane(dev, id);
+}
+
+int
+device_set_crtc(struct device *dev, uint32_t crtc_id, uint32_t fb,
+		uint32_t x, uint32_t y, uint32_t *conns, int count,
+		drmModeModeInfo *mode)
+{
+	return dev->funcs->set_crtc(dev, crtc_id, fb, x, y, conns, count, mode);
+}
+
+int
+device_set_plane(struct device *dev, uint32_t plane_id, uint32_t crtc_id,
+		uint32_t fb, uint32_t flags,
+		int32_t crtc_x, int32_t crtc_y, uint32_t crtc_w, uint32_t crtc_h,
+		uint32_t src_x, uint32_t src_y, uint32_t src_w, uint32_t src_h)
+{
+	return dev->funcs->set_plane(dev, plane_id, crtc_id, fb, flags,
+			crtc_x, crtc_y, crtc_w, crtc_h, src_x, src_y, src_w, src_h);
+}
+
+int
+device_page_flip(struct device *dev, uint32_t crtc_id, uint32_t fb,
+		uint32_t flags, void *data)
+{
+	return dev->funcs->page_flip(dev, crtc_id, fb, flags, data);
+}
+
+int
+device_dirty_fb(struct device *dev, uint32_t fb, drmModeClip *clips, uint32_t count)
+{
+	return dev->funcs->dirty_fb(dev, fb, clips, count);
+}
+
+int
+device_handle_event(struct device *dev, drmEventContext *ctx)
+{
+	return dev->funcs->handle_event(dev, ctx);
+}
+
+int
+device_add_fb2(struct device *dev, uint32_t width, uint32_t height,
+		uint32_t format, const uint32_t handles[4], const uint32_t pitches[4],
+		const uint32_t offsets[4], uint32_t *fb, uint32_t flags)
+{
+	return dev->funcs->add_fb2(dev, width, height, format,
+			handles, pitches, offsets, fb, flags);
+}
+
+int
+device_rm_fb(struct device *dev, uint32_t fb)
+{
+	return dev->funcs->rm_fb(dev, fb);
+}
+
+void *
+device_bo_create(struct device *dev, uint32_t width, uint32_t height,
+		uint32_t *handle, uint32_t *pitch, void **map)
+{
+	return dev->funcs->bo_create(dev, width, height, handle, pitch, map);
+}
+
+void
+device_bo_destroy(struct device *dev, void *bo)
+{
+	dev->funcs->bo_destroy(dev, bo);
+}
+
+int
+device_prime_handle_to_fd(struct device *dev, uint32_t handle, uint32_t flags, int *dmabuf)
+{
+	return dev->funcs->prime_handle_to_fd(dev, handle, flags, dmabuf);
+}
+
+/* mHz from the timings: vrefresh is rounded, 59.94 Hz matters to 29.97 fps */
+unsigned int
+device_mode_refresh(const drmModeModeInfo *mode)
+{
+	uint64_t total = (uint64_t) mode->htotal * mode->vtotal;
+	uint64_t refresh;
+
+	if (!total)
+		return mode->vrefresh * 1000;
+
+	refresh = (uint64_t) mode->clock * 1000000 / total;
+	if (mode->flags & DRM_MODE_FLAG_INTERLACE)
+		refresh *= 2;
+	if (mode->flags & DRM_MODE_FLAG_DBLSCAN)
+		refresh /= 2;
+	if (mode->vscan > 1)
+		refresh /= mode->vscan;
+
+	return refresh;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <stdint.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+/*
+ * The modesetting calls the sinks make, on whatever device_open() found
+ * behind the path: a real DRM device through libdrm and libkms, or the
+ * in-memory one when the path is "memory[:...]" (see memdev.h). The
+ * backend is picked once there, each call just follows dev->funcs.
+ *
+ * The functions mirror their libdrm namesakes, including errno on
+ * failure, and the objects they return are freed with drmModeFree*().
+ * Atomic commits and PRIME imports go straight to libdrm: a device
+ * without those caps never reaches them.
+ */
+
+struct device;
+
+struct device_funcs {
+	int (*open)(struct device *dev, const char *path);
+	void (*close)(struct device *dev);
+
+	int (*get_cap)(struct device *dev, uint64_t cap, uint64_t *value);
+	int (*set_client_cap)(struct device *dev, uint64_t cap, uint64_t value);
+
+	drmModeRes *(*get_resources)(struct device *dev);
+	drmModeConnector *(*get_connector)(struct device *dev, uint32_t id);
+	drmModeConnector *(*get_connector_current)(struct device *dev, uint32_t id);
+	drmModeEncoder *(*get_encoder)(struct device *dev, uint32_t id);
+	drmModeCrtc *(*get_crtc)(struct device *dev, uint32_t id);
+	drmModePlaneRes *(*get_plane_resources)(struct device *dev);
+	drmModePlane *(*get_plane)(struct device *dev, uint32_t id);
+
+	int (*set_crtc)(struct device *dev, uint32_t crtc_id, uint32_t fb,
+			uint32_t x, uint32_t y, uint32_t *conns, int count,
+			drmModeModeInfo *mode);
+	int (*set_plane)(struct device *dev, uint32_t plane_id, uint32_t crtc_id,
+			uint32_t fb, uint32_t flags,
+			int32_t crtc_x, int32_t crtc_y, uint32_t crtc_w, uint32_t crtc_h,
+			uint32_t src_x, uint32_t src_y, uint32_t src_w, uint32_t src_h);
+	int (*page_flip)(struct device *dev, uint32_t crtc_id, uint32_t fb,
+			uint32_t flags, void *data);
+	int (*dirty_fb)(struct device *dev, uint32_t fb, drmModeClip *clips, uint32_t count);
+	int (*handle_event)(struct device *dev, drmEventContext *ctx);
+
+	int (*add_fb2)(struct device *dev, uint32_t width, uint32_t height,
+			uint32_t format, const uint32_t handles[4], const uint32_t pitches[4],
+			const uint32_t offsets[4], uint32_t *fb, uint32_t flags);
+	int (*rm_fb)(struct device *dev, uint32_t fb);
+
+	/* a mapped 32bpp scanout buffer */
+	void *(*bo_create)(struct device *dev, uint32_t width, uint32_t height,
+			uint32_t *handle, uint32_t *pitch, void **map);
+	void (*bo_destroy)(struct device *dev, void *bo);
+	int (*prime_handle_to_fd)(struct device *dev, uint32_t handle,
+			uint32_t flags, int *dmabuf);
+};
+
+struct device {
+	int fd;
+	const struct device_funcs *funcs;
+	void *priv;
+};
+
+/* dev->fd is for poll(), non-blocking and close-on-exec */
+struct device *device_open(const char *path);
+void device_close(struct device *dev);
+
+int device_get_cap(struct device *dev, uint64_t cap, uint64_t *value);
+int device_set_client_cap(struct device *dev, uint64_t cap, uint64_t value);
+
+drmModeRes *device_get_resources(struct device *dev);
+drmModeConnector *device_get_connector(struct device *dev, uint32_t id);
+/* what the kernel already knows, without probing the monitor */
+drmModeConnector *device_get_connector_current(struct device *dev, uint32_t id);
+drmModeEncoder *device_get_encoder(struct device *dev, uint32_t id);
+drmModeCrtc *device_get_crtc(struct device *dev, uint32_t id);
+drmModePlaneRes *device_get_plane_resources(struct device *dev);
+drmModePlane *device_get_plane(struct device *dev, uint32_t id);
+
+int device_set_crtc(struct device *dev, uint32_t crtc_id, uint32_t fb,
+		uint32_t x, uint32_t y, uint32_t *conns, int count,
+		drmModeModeInfo *mode);
+int device_set_plane(struct device *dev, uint32_t plane_id, uint32_t crtc_id,
+		uint32_t fb, uint32_t flags,
+		int32_t crtc_x, int32_t crtc_y, uint32_t crtc_w, uint32_t crtc_h,
+		uint32_t src_x, uint32_t src_y, uint32_t src_w, uint32_t src_h);
+int device_page_flip(struct device *dev, uint32_t crtc_id, uint32_t fb,
+		uint32_t flags, void *data);
+int device_dirty_fb(struct device *dev, uint32_t fb, drmModeClip *clips, uint32_t count);
+int device_handle_event(struct device *dev, drmEventContext *ctx);
+
+int device_add_fb2(struct device *dev, uint32_t width, uint32_t height,
+		uint32_t format, const uint32_t handles[4], const uint32_t pitches[4],
+		const uint32_t offsets[4], uint32_t *fb, uint32_t flags);
+int device_rm_fb(struct device *dev, uint32_t fb);
+
+void *device_bo_create(struct device *dev, uint32_t width, uint32_t height,
+		uint32_t *handle, uint32_t *pitch, void **map);
+void device_bo_destroy(struct device *dev, void *bo);
+int device_prime_handle_to_fd(struct device *dev, uint32_t handle, uint32_t flags, int *dmabuf);
+
+unsigned int device_mode_refresh(const drmModeModeInfo *mode);
+
+#endif /* DEVICE_H */
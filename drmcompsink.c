@@ -0,0 +1,1535 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+/*
+ * Several videos on the planes of one crtc. Every request pad gets a plane
+ * of its own, and the newest frame of each pad goes to the screen in one
+ * atomic commit, so they all change at the same vblank; the display
+ * controller does the compositing. Without atomic modesetting the planes
+ * are set one after the other.
+ *
+ * The commits go through the presentation thread like the pages of the
+ * other sinks: a page of the commit ring stands for "whatever is newest
+ * on every pad" when it gets flipped.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include <xf86drmMode.h>
+#include <xf86drm.h>
+
+#include "drmcompsink.h"
+#include "ring.h"
+#include "present.h"
+#include "format.h"
+#include "convert.h"
+#include "upload.h"
+#include "copy.h"
+#include "atomic.h"
+#include "pool.h"
+#include "log.h"
+#include "device.h"
+
+#define COMP_MAX_PADS	16
+/* one being flipped, one on screen, one waiting */
+#define COMP_COMMITS	3
+
+static void *parent_class;
+static void *pad_parent_class;
+
+#ifndef GST_DISABLE_GST_DEBUG
+GstDebugCategory *drm_debug;
+#endif
+
+enum {
+	PROP_0,
+	PROP_CRTC,
+	PROP_FILE,
+	PROP_BUFFERS,
+	PROP_BACKEND,
+	PROP_POOL_LIMIT,
+	PROP_SYNC,
+};
+
+enum {
+	PROP_PAD_0,
+	PROP_PAD_PLANE,
+	PROP_PAD_POSX,
+	PROP_PAD_POSY,
+	PROP_PAD_WIDTH,
+	PROP_PAD_HEIGHT,
+	PROP_PAD_ZORDER,
+};
+
+struct gst_drm_comp_sink;
+
+struct gst_drm_comp_pad {
+	GstPad parent;
+
+	struct gst_drm_comp_sink *sink;
+
+	/* as set; a plane id of 0 picks a free one */
+	uint32_t req_plane_id;
+	int posx;
+	int posy;
+	uint32_t dst_width;		/* 0 for the video size */
+	uint32_t dst_height;
+	int zorder;			/* -1 for the driver's */
+
+	uint32_t plane_id;
+	struct atomic *atomic;		/* NULL with the legacy backend */
+	uint32_t *plane_formats;
+	uint32_t nr_plane_formats;
+
+	const struct format *format;
+	bool convert;			/* plane can't scan out format, convert to xRGB */
+	struct layout layout;		/* of our scanout buffers */
+	struct layout src_layout;	/* of upstream buffers */
+	uint32_t width;
+	uint32_t height;
+
+	/* under the sink lock */
+	struct ring ring;
+	struct page *ready;		/* newest frame, not committed yet */
+	bool committed;			/* a page of ours is in the commit in flight */
+	/* buffers from before new caps, until a newer commit of ours is done */
+	GSList *retired;		/* on screen */
+	GSList *retiring;		/* in the commit in flight */
+	bool flushing;
+	bool prerolled;			/* a frame was shown while paused */
+	bool eos;
+
+	struct upload *upload;
+	GstSegment segment;
+	GstClockID clock_id;		/* under the object lock */
+};
+
+struct gst_drm_comp_pad_class {
+	GstPadClass parent_class;
+};
+
+struct gst_drm_comp_sink {
+	GstElement parent;
+
+	gchar *device;
+	uint32_t req_crtc_id;		/* 0 picks the first active crtc */
+	unsigned int nr_buffers;
+	enum drm_backend backend;
+	unsigned int pool_limit;	/* MiB */
+	size_t pool_share;		/* bytes added to the pool's limit */
+	bool sync;
+
+	struct pool *pool;
+	struct device *dev;
+	bool use_atomic;
+
+	uint32_t crtc_id;
+	int crtc_index;
+	unsigned int max_framerate;
+
+	/* pages without buffers, one per commit */
+	struct ring commits;
+	struct present *present;
+
+	/* everything below and the pads' pages; signalled when a commit is done */
+	GMutex *lock;
+	GCond *cond;
+	GSList *pads;
+	unsigned int next_pad;
+	bool commit_queued;		/* waiting for the presentation thread */
+	bool playing;
+	bool async;			/* paused when every pad has prerolled */
+	bool eos_posted;
+};
+
+struct gst_drm_comp_sink_class {
+	GstElementClass parent_class;
+};
+
+#define GST_DRMCOMP_BACKEND_TYPE (gst_drmcomp_backend_get_type())
+
+static GType
+gst_drmcomp_backend_get_type(void)
+{
+	static GType type;
+
+	if (G_UNLIKELY(type == 0)) {
+		static const GEnumValue values[] = {
+			{ BACKEND_AUTO, "Atomic when available, legacy otherwise", "auto" },
+			{ BACKEND_LEGACY, "Legacy SetPlane, one plane at a time", "legacy" },
+			{ BACKEND_ATOMIC, "Atomic commits", "atomic" },
+			{ 0, NULL, NULL },
+		};
+
+		type = g_enum_register_static("GstDrmCompBackend", values);
+	}
+
+	return type;
+}
+
+static GstCaps *
+sink_caps(int max_framerate)
+{
+	GstCaps *caps;
+	unsigned int i;
+
+	caps = gst_caps_new_empty();
+
+	for (i = 0; i < nr_formats; i++)
+		gst_caps_append_structure(caps, format_to_structure(&formats[i], max_framerate));
+
+	return caps;
+}
+
+static GstCaps *
+generate_sink_template(void)
+{
+	return sink_caps(FORMAT_MAX_FRAMERATE);
+}
+
+static bool
+plane_supports(struct gst_drm_comp_pad *pad, const struct format *format)
+{
+	uint32_t i;
+
+	for (i = 0; i < pad->nr_plane_formats; i++)
+		if (pad->plane_formats[i] == format->drm_format)
+			return true;
+
+	return false;
+}
+
+static bool
+plane_taken(struct gst_drm_comp_sink *self, uint32_t plane_id)
+{
+	GSList *l;
+
+	for (l = self->pads; l; l = l->next)
+		if (((struct gst_drm_comp_pad *) l->data)->plane_id == plane_id)
+			return true;
+
+	return false;
+}
+
+static bool
+plane_has(const drmModePlane *plane, uint32_t drm_format)
+{
+	uint32_t i;
+
+	for (i = 0; i < plane->count_formats; i++)
+		if (plane->formats[i] == drm_format)
+			return true;
+
+	return false;
+}
+
+/* the requested plane, or the first free overlay of the crtc for the format */
+static bool
+assign_plane(struct gst_drm_comp_sink *self, struct gst_drm_comp_pad *pad,
+		const struct format *format)
+{
+	drmModePlaneRes *resources;
+	drmModePlane *plane;
+	uint32_t i;
+	bool usable;
+
+	resources = device_get_plane_resources(self->dev);
+	if (!resources) {
+		fprintf(stderr, "drmModeGetPlaneResources failed\n");
+		return false;
+	}
+
+	for (i = 0; i < resources->count_planes && !pad->plane_id; i++) {
+		plane = device_get_plane(self->dev, resources->planes[i]);
+		if (!plane)
+			continue;
+
+		if (pad->req_plane_id)
+			usable = plane->plane_id == pad->req_plane_id;
+		else
+			usable = (plane->possible_crtcs & (1 << self->crtc_index)) &&
+				!plane_taken(self, plane->plane_id) &&
+				(!self->use_atomic || atomic_plane_is_overlay(self->dev->fd, plane->plane_id)) &&
+				(plane_has(plane, format->drm_format) ||
+				 (convert_supported(format) && plane_has(plane, formats[0].drm_format)));
+
+		if (usable) {
+			pad->plane_id = plane->plane_id;
+			pad->plane_formats = g_memdup(plane->formats, plane->count_formats * sizeof(*plane->formats));
+			pad->nr_plane_formats = plane->count_formats;
+		}
+
+		drmModeFreePlane(plane);
+	}
+
+	drmModeFreePlaneResources(resources);
+
+	if (!pad->plane_id) {
+		fprintf(stderr, "no free plane for %s\n", GST_PAD_NAME(pad));
+		return false;
+	}
+
+	if (!self->use_atomic) {
+		if (pad->zorder >= 0)
+			fprintf(stderr, "z-order needs atomic modesetting\n");
+		return true;
+	}
+
+	pad->atomic = atomic_new(self->dev->fd, self->crtc_id, 0, pad->plane_id);
+	if (!pad->atomic)
+		return false;
+
+	if (pad->zorder >= 0 && !atomic_set_zpos(pad->atomic, pad->zorder))
+		fprintf(stderr, "plane %u has no z-order to set\n", pad->plane_id);
+
+	return true;
+}
+
+static struct atomic_plane
+plane_state(struct gst_drm_comp_pad *pad, struct page *page)
+{
+	struct atomic_plane plane = {
+		.fb = page->fb,
+		.crtc_x = pad->posx,
+		.crtc_y = pad->posy,
+		.crtc_w = pad->dst_width ? pad->dst_width : pad->width,
+		.crtc_h = pad->dst_height ? pad->dst_height : pad->height,
+		.src_w = pad->width << 16,
+		.src_h = pad->height << 16,
+	};
+
+	return plane;
+}
+
+static void
+put_buffers(struct gst_drm_comp_sink *self, GSList **list)
+{
+	GSList *l;
+
+	for (l = *list; l; l = l->next)
+		pool_put(self->pool, l->data);
+
+	g_slist_free(*list);
+	*list = NULL;
+}
+
+/*
+ * Pages of the old caps go back to the pool, those in the commit in flight
+ * or on screen once commit_done() sees them replaced. Under the sink lock.
+ */
+static void
+retire_pages(struct gst_drm_comp_sink *self, struct gst_drm_comp_pad *pad)
+{
+	unsigned int i;
+
+	for (i = 0; i < pad->ring.count; i++) {
+		struct page *page = &pad->ring.pages[i];
+
+		if (!page->buffer)
+			continue;
+
+		switch (g_atomic_int_get(&page->state)) {
+		case PAGE_QUEUED:
+			pad->retiring = g_slist_prepend(pad->retiring, page->buffer);
+			break;
+		case PAGE_SCANOUT:
+			pad->retired = g_slist_prepend(pad->retired, page->buffer);
+			break;
+		default:
+			pool_put(self->pool, page->buffer);
+			break;
+		}
+
+		page->buffer = NULL;
+	}
+
+	pad->ready = NULL;
+}
+
+/* plane off and every buffer back, the pad starts over with its next caps */
+static void
+reset_pad(struct gst_drm_comp_sink *self, struct gst_drm_comp_pad *pad)
+{
+	unsigned int i;
+
+	if (pad->plane_id) {
+		if (pad->atomic) {
+			struct atomic_plane off = { .fb = 0 };
+
+			atomic_flip(pad->atomic, &off, 0, NULL);
+		} else {
+			device_set_plane(self->dev, pad->plane_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		}
+	}
+
+	for (i = 0; i < pad->ring.count; i++) {
+		struct page *page = &pad->ring.pages[i];
+
+		if (page->buffer)
+			pool_put(self->pool, page->buffer);
+		page->buffer = NULL;
+	}
+
+	put_buffers(self, &pad->retired);
+	put_buffers(self, &pad->retiring);
+
+	if (pad->atomic) {
+		atomic_free(pad->atomic);
+		pad->atomic = NULL;
+	}
+
+	g_free(pad->plane_formats);
+	pad->plane_formats = NULL;
+	pad->nr_plane_formats = 0;
+	pad->plane_id = 0;
+
+	pad->ready = NULL;
+	pad->committed = false;
+	pad->format = NULL;
+}
+
+/* runs on the presentation thread: the newest frame of every pad, together */
+static bool
+flip(void *data, struct page *commit)
+{
+	struct gst_drm_comp_sink *self = data;
+	struct gst_drm_comp_pad *pads[COMP_MAX_PADS];
+	struct page *pages[COMP_MAX_PADS];
+	struct atomic_plane planes[COMP_MAX_PADS];
+	struct atomic *atomics[COMP_MAX_PADS];
+	unsigned int i = 0, n = 0;
+	GSList *l;
+	int ret;
+
+	g_mutex_lock(self->lock);
+
+	self->commit_queued = false;
+
+	for (l = self->pads; l; l = l->next) {
+		struct gst_drm_comp_pad *pad = l->data;
+
+		if (!pad->ready)
+			continue;
+
+		ring_set_state(pad->ready, PAGE_QUEUED);
+		pages[n] = pad->ready;
+		planes[n] = plane_state(pad, pad->ready);
+		atomics[n] = pad->atomic;
+		pad->ready = NULL;
+		pad->committed = true;
+		pads[n++] = pad;
+	}
+
+	/* the pads with a frame got new caps or were released since */
+	if (!n) {
+		g_mutex_unlock(self->lock);
+		present_skip(self->present);
+		return true;
+	}
+
+	/* still under the lock, release_pad() frees the atomic state of a pad */
+	if (self->use_atomic) {
+		ret = atomic_commit(atomics, planes, n,
+				DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, self->present);
+		if (!ret)
+			goto done;
+
+		fprintf(stderr, "failed drmModeAtomicCommit(): %s\n", strerror(-ret));
+		goto failed;
+	}
+
+	for (; i < n; i++) {
+		ret = device_set_plane(self->dev, pads[i]->plane_id, self->crtc_id, planes[i].fb, 0,
+				planes[i].crtc_x, planes[i].crtc_y, planes[i].crtc_w, planes[i].crtc_h,
+				planes[i].src_x, planes[i].src_y, planes[i].src_w, planes[i].src_h);
+		if (ret) {
+			fprintf(stderr, "cannot set plane %u\n", pads[i]->plane_id);
+			goto failed;
+		}
+	}
+
+done:
+	g_mutex_unlock(self->lock);
+	return true;
+
+	/*
+	 * Nothing of a failed atomic commit is shown, but the planes set before
+	 * a legacy failure are: those stay committed for the next commit_done().
+	 */
+failed:
+	for (; i < n; i++) {
+		ring_set_state(pages[i], PAGE_FREE);
+		pads[i]->committed = false;
+	}
+	g_cond_broadcast(self->cond);
+	g_mutex_unlock(self->lock);
+
+	return false;
+}
+
+/* the commit is on screen, the pages it replaced are free */
+static void
+commit_done(void *data)
+{
+	struct gst_drm_comp_sink *self = data;
+	GSList *l;
+
+	g_mutex_lock(self->lock);
+
+	for (l = self->pads; l; l = l->next) {
+		struct gst_drm_comp_pad *pad = l->data;
+
+		if (!pad->committed)
+			continue;
+
+		ring_flip_done(&pad->ring);
+		pad->committed = false;
+
+		/* replaced on screen by this commit, which may show a retired one */
+		put_buffers(self, &pad->retired);
+		pad->retired = pad->retiring;
+		pad->retiring = NULL;
+	}
+
+	g_cond_broadcast(self->cond);
+	g_mutex_unlock(self->lock);
+}
+
+static GstCaps *
+pad_getcaps(GstPad *gpad)
+{
+	struct gst_drm_comp_pad *pad = (struct gst_drm_comp_pad *) gpad;
+	struct gst_drm_comp_sink *self = pad->sink;
+
+	/* no point in more frames than the crtc shows */
+	return sink_caps(self->pool ? self->max_framerate : FORMAT_MAX_FRAMERATE);
+}
+
+static gboolean
+pad_setcaps(GstPad *gpad, GstCaps *caps)
+{
+	struct gst_drm_comp_pad *pad = (struct gst_drm_comp_pad *) gpad;
+	struct gst_drm_comp_sink *self = pad->sink;
+	GstStructure *structure;
+	const struct format *format, *scanout;
+	int width, height;
+	unsigned int i;
+	bool ok;
+	int ret;
+
+	structure = gst_caps_get_structure(caps, 0);
+
+	if (!gst_structure_get_int(structure, "width", &width) ||
+			!gst_structure_get_int(structure, "height", &height))
+		return false;
+
+	format = format_from_structure(structure);
+	if (!format) {
+		fprintf(stderr, "unknown format\n");
+		return false;
+	}
+
+	if (format == pad->format && (uint32_t) width == pad->width && (uint32_t) height == pad->height)
+		return true;
+
+	g_mutex_lock(self->lock);
+	ok = pad->plane_id || assign_plane(self, pad, format);
+	g_mutex_unlock(self->lock);
+
+	if (!ok)
+		return false;
+
+	if (plane_supports(pad, format)) {
+		scanout = format;
+	} else if (convert_supported(format) && plane_supports(pad, &formats[0])) {
+		scanout = &formats[0];
+	} else {
+		fprintf(stderr, "plane %u can't scan out the negotiated format\n", pad->plane_id);
+		return false;
+	}
+
+	g_mutex_lock(self->lock);
+
+	retire_pages(self, pad);
+
+	pad->format = format;
+	pad->convert = scanout != format;
+	pad->width = width;
+	pad->height = height;
+
+	format_gst_layout(format, width, height, &pad->src_layout);
+
+	ring_init(&pad->ring, self->nr_buffers);
+
+	for (i = 0; i < pad->ring.count; i++) {
+		struct page *page = &pad->ring.pages[i];
+
+		page->buffer = pool_get(self->pool, scanout, width, height);
+		if (!page->buffer) {
+			pad->format = NULL;
+			g_mutex_unlock(self->lock);
+			return false;
+		}
+
+		page->frame = page->buffer->frame;
+		page->stride = page->buffer->pitch;
+		page->fb = page->buffer->fb;
+
+		format_bo_layout(scanout, width, height, page->stride, &pad->layout);
+	}
+
+	g_mutex_unlock(self->lock);
+
+	/* check the driver takes our format, scaling and position before streaming */
+	if (pad->atomic) {
+		struct atomic_plane plane = plane_state(pad, &pad->ring.pages[0]);
+
+		ret = atomic_flip(pad->atomic, &plane, DRM_MODE_ATOMIC_TEST_ONLY, NULL);
+		if (ret) {
+			fprintf(stderr, "plane configuration rejected: %s\n", strerror(-ret));
+			pad->format = NULL;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void
+set_flushing(struct gst_drm_comp_sink *self, struct gst_drm_comp_pad *pad, bool flushing)
+{
+	g_mutex_lock(self->lock);
+	pad->flushing = flushing;
+	if (!flushing)
+		pad->prerolled = false;
+	g_cond_broadcast(self->cond);
+	g_mutex_unlock(self->lock);
+
+	GST_OBJECT_LOCK(pad);
+	if (flushing && pad->clock_id)
+		gst_clock_id_unschedule(pad->clock_id);
+	GST_OBJECT_UNLOCK(pad);
+}
+
+static void
+set_playing(struct gst_drm_comp_sink *self, bool playing)
+{
+	g_mutex_lock(self->lock);
+	self->playing = playing;
+	g_cond_broadcast(self->cond);
+	g_mutex_unlock(self->lock);
+}
+
+/* under the lock: true once, when every pad has a frame up or is done */
+static bool
+preroll_done(struct gst_drm_comp_sink *self)
+{
+	GSList *l;
+
+	if (!self->async)
+		return false;
+
+	for (l = self->pads; l; l = l->next) {
+		struct gst_drm_comp_pad *pad = l->data;
+
+		if (!pad->prerolled && !pad->eos)
+			return false;
+	}
+
+	self->async = false;
+	return true;
+}
+
+static void
+post_async_done(struct gst_drm_comp_sink *self)
+{
+	gst_element_post_message(GST_ELEMENT(self), gst_message_new_async_done(GST_OBJECT(self)));
+}
+
+/* after a flush the pads preroll again, as if the sink went back to paused */
+static void
+lose_state(struct gst_drm_comp_sink *self)
+{
+	bool lost;
+
+	g_mutex_lock(self->lock);
+	lost = !self->async && GST_STATE(self) >= GST_STATE_PAUSED;
+	if (lost) {
+		self->async = true;
+		self->playing = false;
+	}
+	self->eos_posted = false;
+	g_mutex_unlock(self->lock);
+
+	if (lost)
+		gst_element_lost_state(GST_ELEMENT(self));
+}
+
+/* the last frame of the pad goes on screen first, and that only when playing */
+static bool
+wait_for_eos(struct gst_drm_comp_sink *self, struct gst_drm_comp_pad *pad)
+{
+	bool done;
+
+	g_mutex_lock(self->lock);
+	while (!pad->flushing && !present_failed(self->present) &&
+			(!self->playing || pad->ready || pad->committed))
+		g_cond_wait(self->cond, self->lock);
+	done = !pad->flushing;
+	g_mutex_unlock(self->lock);
+
+	return done;
+}
+
+/* true for whichever pad is done last, the sink posts EOS once */
+static bool
+eos_reached(struct gst_drm_comp_sink *self)
+{
+	GSList *l;
+	bool eos;
+
+	g_mutex_lock(self->lock);
+	eos = !self->eos_posted;
+	for (l = self->pads; l && eos; l = l->next) {
+		struct gst_drm_comp_pad *pad = l->data;
+
+		eos = pad->eos && !pad->ready && !pad->committed;
+	}
+	if (eos)
+		self->eos_posted = true;
+	g_mutex_unlock(self->lock);
+
+	return eos;
+}
+
+static gboolean
+pad_event(GstPad *gpad, GstEvent *event)
+{
+	struct gst_drm_comp_pad *pad = (struct gst_drm_comp_pad *) gpad;
+	struct gst_drm_comp_sink *self = pad->sink;
+	bool async_done;
+
+	switch (GST_EVENT_TYPE(event)) {
+	case GST_EVENT_FLUSH_START:
+		set_flushing(self, pad, true);
+		break;
+	case GST_EVENT_FLUSH_STOP:
+		gst_segment_init(&pad->segment, GST_FORMAT_TIME);
+		pad->eos = false;
+		set_flushing(self, pad, false);
+		lose_state(self);
+		break;
+	case GST_EVENT_NEWSEGMENT: {
+		gboolean update;
+		gdouble rate, arate;
+		GstFormat format;
+		gint64 start, stop, time;
+
+		gst_event_parse_new_segment_full(event, &update, &rate, &arate, &format,
+				&start, &stop, &time);
+		gst_segment_set_newsegment_full(&pad->segment, update, rate, arate, format,
+				start, stop, time);
+		break;
+	}
+	case GST_EVENT_EOS:
+		/* a pad without frames counts as prerolled */
+		g_mutex_lock(self->lock);
+		pad->eos = true;
+		async_done = preroll_done(self);
+		g_mutex_unlock(self->lock);
+
+		if (async_done)
+			post_async_done(self);
+
+		/* a sink posts it once all of its streams are done and shown */
+		if (wait_for_eos(self, pad) && eos_reached(self))
+			gst_element_post_message(GST_ELEMENT(self), gst_message_new_eos(GST_OBJECT(self)));
+		break;
+	default:
+		break;
+	}
+
+	gst_event_unref(event);
+
+	return true;
+}
+
+/*
+ * The first frame shows while paused, the rest waits for playing and, with
+ * sync, for its running time. False when flushing.
+ */
+static bool
+wait_for_time(struct gst_drm_comp_sink *self, struct gst_drm_comp_pad *pad, GstBuffer *buffer)
+{
+	GstClockTime timestamp, running;
+	GstClock *clock;
+	GstClockID id;
+	bool playing;
+
+	g_mutex_lock(self->lock);
+	while (!self->playing && pad->prerolled && !pad->flushing)
+		g_cond_wait(self->cond, self->lock);
+	playing = self->playing;
+	g_mutex_unlock(self->lock);
+
+	timestamp = GST_BUFFER_TIMESTAMP(buffer);
+	if (!playing || !self->sync || !GST_CLOCK_TIME_IS_VALID(timestamp))
+		return !pad->flushing;
+
+	running = gst_segment_to_running_time(&pad->segment, GST_FORMAT_TIME, timestamp);
+	if (!GST_CLOCK_TIME_IS_VALID(running))
+		return !pad->flushing;
+
+	clock = gst_element_get_clock(GST_ELEMENT(self));
+	if (!clock)
+		return !pad->flushing;
+
+	id = gst_clock_new_single_shot_id(clock, gst_element_get_base_time(GST_ELEMENT(self)) + running);
+	gst_object_unref(clock);
+
+	GST_OBJECT_LOCK(pad);
+	if (!pad->flushing) {
+		pad->clock_id = id;
+		GST_OBJECT_UNLOCK(pad);
+
+		gst_clock_id_wait(id, NULL);
+
+		GST_OBJECT_LOCK(pad);
+		pad->clock_id = NULL;
+	}
+	GST_OBJECT_UNLOCK(pad);
+
+	gst_clock_id_unref(id);
+
+	return !pad->flushing;
+}
+
+/* block only when every page of the pad is busy */
+static struct page *
+get_page(struct gst_drm_comp_sink *self, struct gst_drm_comp_pad *pad)
+{
+	struct page *page;
+
+	g_mutex_lock(self->lock);
+	while (!(page = ring_get_free(&pad->ring))) {
+		if (pad->flushing || present_failed(self->present))
+			break;
+		g_cond_wait(self->cond, self->lock);
+	}
+	g_mutex_unlock(self->lock);
+
+	return page;
+}
+
+static GstFlowReturn
+pad_chain(GstPad *gpad, GstBuffer *buffer)
+{
+	struct gst_drm_comp_pad *pad = (struct gst_drm_comp_pad *) gpad;
+	struct gst_drm_comp_sink *self = pad->sink;
+	struct page *page, *commit;
+	GstFlowReturn ret = GST_FLOW_OK;
+	bool async_done;
+	gint64 start;
+
+	trace(TRACE_FRAME, pad, 0);
+
+	if (!pad->format) {
+		gst_buffer_unref(buffer);
+		return GST_FLOW_NOT_NEGOTIATED;
+	}
+
+	if (GST_BUFFER_SIZE(buffer) < pad->src_layout.size) {
+		fprintf(stderr, "Incoming buffer is less than expected. Some negotiation problem occured...\n");
+		gst_buffer_unref(buffer);
+		return GST_FLOW_ERROR;
+	}
+
+	if (!wait_for_time(self, pad, buffer)) {
+		gst_buffer_unref(buffer);
+		return GST_FLOW_WRONG_STATE;
+	}
+
+	page = get_page(self, pad);
+	if (!page) {
+		trace(TRACE_DROP, pad, 0);
+		gst_buffer_unref(buffer);
+		return present_failed(self->present) ? GST_FLOW_ERROR : GST_FLOW_WRONG_STATE;
+	}
+
+	start = g_get_monotonic_time();
+
+	{
+		struct upload_job job = {
+			.format = pad->format,
+			.convert = pad->convert,
+			.src = &pad->src_layout,
+			.data = GST_BUFFER_DATA(buffer),
+			.dst = &pad->layout,
+			.frame = page->frame,
+			.width = pad->width,
+			.height = pad->height,
+		};
+
+		upload_frame(pad->upload, &job);
+	}
+
+	trace(TRACE_COPY, pad, g_get_monotonic_time() - start);
+	gst_buffer_unref(buffer);
+
+	g_mutex_lock(self->lock);
+
+	/* never shown, the newer frame takes its place in the next commit */
+	if (pad->ready) {
+		trace(TRACE_DROP, pad, pad->ready->fb);
+		ring_set_state(pad->ready, PAGE_FREE);
+	}
+
+	ring_set_state(page, PAGE_READY);
+	pad->ready = page;
+	pad->prerolled = true;
+
+	if (!self->commit_queued) {
+		commit = ring_get_free(&self->commits);
+		self->commit_queued = commit && present_queue(self->present, commit);
+		if (!self->commit_queued)
+			ret = GST_FLOW_ERROR;
+	}
+
+	async_done = preroll_done(self);
+
+	g_mutex_unlock(self->lock);
+
+	if (async_done)
+		post_async_done(self);
+
+	return ret;
+}
+
+/* the first crtc showing something, or the one asked for */
+static bool
+find_crtc(struct gst_drm_comp_sink *self)
+{
+	drmModeRes *resources;
+	drmModeCrtc *crtc;
+	int i;
+
+	resources = device_get_resources(self->dev);
+	if (!resources) {
+		fprintf(stderr, "drmModeGetResources failed\n");
+		return false;
+	}
+
+	self->crtc_id = 0;
+
+	for (i = 0; i < resources->count_crtcs && !self->crtc_id; i++) {
+		if (self->req_crtc_id && resources->crtcs[i] != self->req_crtc_id)
+			continue;
+
+		crtc = device_get_crtc(self->dev, resources->crtcs[i]);
+		if (!crtc)
+			continue;
+
+		if (crtc->mode_valid) {
+			self->crtc_id = crtc->crtc_id;
+			self->crtc_index = i;
+			self->max_framerate = (device_mode_refresh(&crtc->mode) + 999) / 1000;
+		}
+
+		drmModeFreeCrtc(crtc);
+	}
+
+	drmModeFreeResources(resources);
+
+	if (!self->crtc_id) {
+		fprintf(stderr, "no active crtc\n");
+		return false;
+	}
+
+	return true;
+}
+
+static bool
+open_device(struct gst_drm_comp_sink *self)
+{
+	/* or share it with other drmcompsinks */
+	self->pool_share = (size_t) self->pool_limit << 20;
+	self->pool = pool_open(self->device, self->pool_share);
+	if (!self->pool)
+		return false;
+
+	self->dev = pool_device(self->pool);
+
+	/* also lists the primary and cursor planes, assign_plane() skips them */
+	self->use_atomic = self->backend != BACKEND_LEGACY && atomic_enable(self->dev);
+
+	if (self->backend == BACKEND_ATOMIC && !self->use_atomic) {
+		fprintf(stderr, "atomic modesetting not available\n");
+		goto fail;
+	}
+
+	if (!find_crtc(self))
+		goto fail;
+
+	return true;
+
+fail:
+	pool_unref(self->pool, self->pool_share);
+	self->pool = NULL;
+	return false;
+}
+
+static void
+close_device(struct gst_drm_comp_sink *self)
+{
+	pool_unref(self->pool, self->pool_share);
+	self->pool = NULL;
+	self->dev = NULL;
+}
+
+static bool
+start(struct gst_drm_comp_sink *self)
+{
+	GSList *l;
+
+	ring_init(&self->commits, COMP_COMMITS);
+	self->commit_queued = false;
+	self->eos_posted = false;
+	/* paused once every pad shows a frame, there are none to wait for without pads */
+	self->async = self->pads != NULL;
+
+	for (l = self->pads; l; l = l->next) {
+		struct gst_drm_comp_pad *pad = l->data;
+
+		pad->flushing = false;
+		pad->prerolled = false;
+		pad->eos = false;
+	}
+
+	/* atomic commits complete with a page flip event */
+	self->present = present_new(self->dev, &self->commits, flip, self->use_atomic, self);
+	if (!self->present)
+		return false;
+
+	present_set_done(self->present, commit_done);
+
+	return true;
+}
+
+static void
+stop(struct gst_drm_comp_sink *self)
+{
+	GSList *l;
+
+	if (self->present) {
+		present_free(self->present);
+		self->present = NULL;
+	}
+
+	trace_dump();
+
+	g_mutex_lock(self->lock);
+	for (l = self->pads; l; l = l->next)
+		reset_pad(self, l->data);
+	g_mutex_unlock(self->lock);
+}
+
+static GstStateChangeReturn
+change_state(GstElement *element, GstStateChange transition)
+{
+	struct gst_drm_comp_sink *self = (struct gst_drm_comp_sink *) element;
+	GstStateChangeReturn ret;
+	GSList *l;
+
+	switch (transition) {
+	case GST_STATE_CHANGE_NULL_TO_READY:
+		if (!open_device(self))
+			return GST_STATE_CHANGE_FAILURE;
+		break;
+	case GST_STATE_CHANGE_READY_TO_PAUSED:
+		if (!start(self))
+			return GST_STATE_CHANGE_FAILURE;
+		if (self->async)
+			gst_element_post_message(element, gst_message_new_async_start(GST_OBJECT(self), false));
+		break;
+	case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+		set_playing(self, true);
+		break;
+	case GST_STATE_CHANGE_PAUSED_TO_READY:
+		/* the pads are deactivated next, their streaming threads must not block */
+		for (l = self->pads; l; l = l->next)
+			set_flushing(self, l->data, true);
+		break;
+	default:
+		break;
+	}
+
+	ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+	if (ret == GST_STATE_CHANGE_FAILURE)
+		return ret;
+
+	switch (transition) {
+	case GST_STATE_CHANGE_READY_TO_PAUSED:
+		g_mutex_lock(self->lock);
+		if (self->async)
+			ret = GST_STATE_CHANGE_ASYNC;
+		g_mutex_unlock(self->lock);
+		break;
+	case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+		set_playing(self, false);
+		break;
+	case GST_STATE_CHANGE_PAUSED_TO_READY:
+		stop(self);
+		break;
+	case GST_STATE_CHANGE_READY_TO_NULL:
+		close_device(self);
+		break;
+	default:
+		break;
+	}
+
+	return ret;
+}
+
+static GstPad *
+request_new_pad(GstElement *element, GstPadTemplate *templ, const gchar *name)
+{
+	struct gst_drm_comp_sink *self = (struct gst_drm_comp_sink *) element;
+	struct gst_drm_comp_pad *pad;
+	gchar *pad_name = NULL;
+
+	g_mutex_lock(self->lock);
+
+	if (g_slist_length(self->pads) >= COMP_MAX_PADS) {
+		g_mutex_unlock(self->lock);
+		fprintf(stderr, "no more than %u pads\n", COMP_MAX_PADS);
+		return NULL;
+	}
+
+	if (!name)
+		name = pad_name = g_strdup_printf("sink_%u", self->next_pad++);
+
+	g_mutex_unlock(self->lock);
+
+	pad = g_object_new(GST_DRMCOMP_PAD_TYPE, "name", name,
+			"direction", GST_PAD_SINK, "template", templ, NULL);
+	g_free(pad_name);
+
+	pad->sink = self;
+	pad->upload = upload_new(1);
+
+	gst_pad_set_chain_function(GST_PAD(pad), pad_chain);
+	gst_pad_set_event_function(GST_PAD(pad), pad_event);
+	gst_pad_set_setcaps_function(GST_PAD(pad), pad_setcaps);
+	gst_pad_set_getcaps_function(GST_PAD(pad), pad_getcaps);
+
+	g_mutex_lock(self->lock);
+	self->pads = g_slist_append(self->pads, pad);
+	g_mutex_unlock(self->lock);
+
+	if (GST_STATE(self) > GST_STATE_READY)
+		gst_pad_set_active(GST_PAD(pad), true);
+
+	gst_element_add_pad(element, GST_PAD(pad));
+
+	return GST_PAD(pad);
+}
+
+static void
+release_pad(GstElement *element, GstPad *gpad)
+{
+	struct gst_drm_comp_sink *self = (struct gst_drm_comp_sink *) element;
+	struct gst_drm_comp_pad *pad = (struct gst_drm_comp_pad *) gpad;
+	bool async_done;
+
+	/* out of get_page() and wait_for_time(), then out of pad_chain() for good */
+	set_flushing(self, pad, true);
+	gst_pad_set_active(gpad, false);
+
+	/*
+	 * No commit takes its frames from now on. Turning the plane off waits
+	 * for one in flight, so every buffer of the pad is free after it.
+	 */
+	g_mutex_lock(self->lock);
+	self->pads = g_slist_remove(self->pads, pad);
+	reset_pad(self, pad);
+	/* the last pad not prerolled yet */
+	async_done = preroll_done(self);
+	g_mutex_unlock(self->lock);
+
+	if (async_done)
+		post_async_done(self);
+
+	upload_free(pad->upload);
+	pad->upload = NULL;
+
+	gst_element_remove_pad(element, gpad);
+}
+
+/* pads */
+
+static void
+pad_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+	struct gst_drm_comp_pad *pad = (struct gst_drm_comp_pad *) object;
+
+	switch (prop_id) {
+		case PROP_PAD_PLANE:
+			g_value_set_int (value, pad->plane_id ? pad->plane_id : pad->req_plane_id);
+			break;
+		case PROP_PAD_POSX:
+			g_value_set_int (value, pad->posx);
+			break;
+		case PROP_PAD_POSY:
+			g_value_set_int (value, pad->posy);
+			break;
+		case PROP_PAD_WIDTH:
+			g_value_set_int (value, pad->dst_width);
+			break;
+		case PROP_PAD_HEIGHT:
+			g_value_set_int (value, pad->dst_height);
+			break;
+		case PROP_PAD_ZORDER:
+			g_value_set_int (value, pad->zorder);
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+pad_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+	struct gst_drm_comp_pad *pad = (struct gst_drm_comp_pad *) object;
+
+	switch (prop_id) {
+		case PROP_PAD_PLANE:
+			pad->req_plane_id = g_value_get_int (value);
+			break;
+		case PROP_PAD_POSX:
+			pad->posx = g_value_get_int (value);
+			break;
+		case PROP_PAD_POSY:
+			pad->posy = g_value_get_int (value);
+			break;
+		case PROP_PAD_WIDTH:
+			pad->dst_width = g_value_get_int (value);
+			break;
+		case PROP_PAD_HEIGHT:
+			pad->dst_height = g_value_get_int (value);
+			break;
+		case PROP_PAD_ZORDER:
+			pad->zorder = g_value_get_int (value);
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+pad_finalize(GObject *object)
+{
+	struct gst_drm_comp_pad *pad = (struct gst_drm_comp_pad *) object;
+
+	/* unless release_pad() did already */
+	if (pad->upload)
+		upload_free(pad->upload);
+
+	G_OBJECT_CLASS(pad_parent_class)->finalize(object);
+}
+
+static void
+pad_class_init(void *g_class, void *class_data)
+{
+	GObjectClass *gobject_class = g_class;
+
+	pad_parent_class = g_type_class_peek_parent(g_class);
+
+	gobject_class->get_property = pad_get_property;
+	gobject_class->set_property = pad_set_property;
+	gobject_class->finalize = pad_finalize;
+
+	/* read when the next frame is committed, except plane and zorder */
+
+	g_object_class_install_property (gobject_class, PROP_PAD_PLANE,
+			g_param_spec_int ("plane", "plane_id", "DRM plane id (0 = a free overlay plane)",
+				0, 1024, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_PAD_POSX,
+			g_param_spec_int ("xpos", "xpos", "X position of the video on the crtc",
+				-4096, 4096, DEFAULT_PROP_PAD_POS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_PAD_POSY,
+			g_param_spec_int ("ypos", "ypos", "Y position of the video on the crtc",
+				-4096, 4096, DEFAULT_PROP_PAD_POS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_PAD_WIDTH,
+			g_param_spec_int ("width", "width", "Width the plane scales the video to (0 = video width)",
+				0, 4096, DEFAULT_PROP_PAD_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_PAD_HEIGHT,
+			g_param_spec_int ("height", "height", "Height the plane scales the video to (0 = video height)",
+				0, 4096, DEFAULT_PROP_PAD_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_PAD_ZORDER,
+			g_param_spec_int ("zorder", "zorder", "Stacking order of the plane, atomic only (-1 = the driver's)",
+				-1, 255, DEFAULT_PROP_PAD_ZORDER, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+pad_instance_init(GTypeInstance *instance, void *g_class)
+{
+	struct gst_drm_comp_pad *pad = (struct gst_drm_comp_pad *)instance;
+
+	pad->posx = DEFAULT_PROP_PAD_POS;
+	pad->posy = DEFAULT_PROP_PAD_POS;
+	pad->dst_width = DEFAULT_PROP_PAD_SIZE;
+	pad->dst_height = DEFAULT_PROP_PAD_SIZE;
+	pad->zorder = DEFAULT_PROP_PAD_ZORDER;
+
+	gst_segment_init(&pad->segment, GST_FORMAT_TIME);
+}
+
+GType
+gst_drmcomp_pad_get_type(void)
+{
+	static GType type;
+
+	if (G_UNLIKELY(type == 0)) {
+		GTypeInfo type_info = {
+			.class_size = sizeof(struct gst_drm_comp_pad_class),
+			.class_init = pad_class_init,
+			.instance_size = sizeof(struct gst_drm_comp_pad),
+			.instance_init = pad_instance_init,
+		};
+
+		type = g_type_register_static(GST_TYPE_PAD, "GstDrmCompPad", &type_info, 0);
+	}
+
+	return type;
+}
+
+/* element */
+
+static void
+get_property (GObject * object, guint prop_id,
+	GValue *value, GParamSpec *pspec)
+{
+	struct gst_drm_comp_sink *self = (struct gst_drm_comp_sink *) object;
+
+	switch (prop_id) {
+		case PROP_CRTC:
+			g_value_set_int (value, self->crtc_id ? self->crtc_id : self->req_crtc_id);
+			break;
+		case PROP_FILE:
+			g_value_set_string (value, self->device);
+			break;
+		case PROP_BUFFERS:
+			g_value_set_int (value, self->nr_buffers);
+			break;
+		case PROP_BACKEND:
+			g_value_set_enum (value, self->backend);
+			break;
+		case PROP_POOL_LIMIT:
+			g_value_set_int (value, self->pool_limit);
+			break;
+		case PROP_SYNC:
+			g_value_set_boolean (value, self->sync);
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+set_property (GObject * object, guint prop_id,
+	const GValue *value, GParamSpec *pspec)
+{
+	struct gst_drm_comp_sink *self = (struct gst_drm_comp_sink *) object;
+
+	switch (prop_id) {
+		case PROP_CRTC:
+			self->req_crtc_id = g_value_get_int (value);
+			break;
+		case PROP_FILE:
+			g_free(self->device);
+			self->device = g_strdup (g_value_get_string (value));
+			if (self->device == NULL) {
+				self->device = g_strdup(DEFAULT_PROP_FILE);
+			}
+			break;
+		case PROP_BUFFERS:
+			self->nr_buffers = g_value_get_int (value);
+			break;
+		case PROP_BACKEND:
+			self->backend = g_value_get_enum (value);
+			break;
+		case PROP_POOL_LIMIT:
+			self->pool_limit = g_value_get_int (value);
+			break;
+		case PROP_SYNC:
+			self->sync = g_value_get_boolean (value);
+			break;
+		default:
+			break;
+	}
+}
+
+static void
+finalize(GObject *object)
+{
+	struct gst_drm_comp_sink *self = (struct gst_drm_comp_sink *) object;
+
+	/* the pads were removed by dispose, only the list is left */
+	g_slist_free(self->pads);
+	g_mutex_free(self->lock);
+	g_cond_free(self->cond);
+	g_free(self->device);
+
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void
+class_init(void *g_class, void *class_data)
+{
+	GObjectClass *gobject_class;
+	GstElementClass *element_class;
+
+	gobject_class = (GObjectClass *) g_class;
+	element_class = g_class;
+
+	parent_class = g_type_class_peek_parent(g_class);
+
+	gobject_class->get_property = get_property;
+	gobject_class->set_property = set_property;
+	gobject_class->finalize = finalize;
+
+	g_object_class_install_property (gobject_class, PROP_CRTC,
+			g_param_spec_int ("crtc", "crtc_id", "DRM crtc id (0 = first active)",
+				0, 1024, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_FILE,
+			g_param_spec_string ("device", "device", "DRM device, or memory[:WxH[@HZ]][,dump=FILE] for one in memory",
+				DEFAULT_PROP_FILE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_BUFFERS,
+			g_param_spec_int ("buffers", "buffers", "Number of scanout buffers per pad",
+				RING_MIN_PAGES, RING_MAX_PAGES, DEFAULT_PROP_BUFFERS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_BACKEND,
+			g_param_spec_enum ("backend", "backend", "Modesetting interface",
+				GST_DRMCOMP_BACKEND_TYPE, DEFAULT_PROP_BACKEND, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_POOL_LIMIT,
+			g_param_spec_int ("pool-limit", "pool-limit", "MiB of idle scanout buffers kept for reuse, added to what other sinks of this kind on the device ask for",
+				0, 4096, DEFAULT_PROP_POOL_LIMIT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_SYNC,
+			g_param_spec_boolean ("sync", "sync", "Show frames at their running time on the clock",
+				DEFAULT_PROP_SYNC, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	element_class->change_state = change_state;
+	element_class->request_new_pad = request_new_pad;
+	element_class->release_pad = release_pad;
+}
+
+static void
+instance_init(GTypeInstance *instance, void *g_class)
+{
+	struct gst_drm_comp_sink *self = (struct gst_drm_comp_sink *)instance;
+
+	self->device = g_strdup(DEFAULT_PROP_FILE);
+	self->nr_buffers = DEFAULT_PROP_BUFFERS;
+	self->backend = DEFAULT_PROP_BACKEND;
+	self->pool_limit = DEFAULT_PROP_POOL_LIMIT;
+	self->sync = DEFAULT_PROP_SYNC;
+	self->dev = NULL;
+
+	self->lock = g_mutex_new();
+	self->cond = g_cond_new();
+
+	/* for EOS and the latency of the bin */
+	GST_OBJECT_FLAG_SET(self, GST_ELEMENT_IS_SINK);
+}
+
+static void
+base_init(void *g_class)
+{
+	GstElementClass *element_class = g_class;
+	GstPadTemplate *template;
+
+	gst_element_class_set_details_simple(element_class,
+			"Linux DRM compositing sink",
+			"Sink/Video",
+			"Shows several videos on the planes of one crtc",
+			"matsi");
+
+	template = gst_pad_template_new("sink_%d", GST_PAD_SINK,
+			GST_PAD_REQUEST,
+			generate_sink_template());
+
+	gst_element_class_add_pad_template(element_class, template);
+
+	gst_object_unref(template);
+}
+
+GType
+gst_drmcomp_sink_get_type(void)
+{
+	static GType type;
+
+	if (G_UNLIKELY(type == 0)) {
+		GTypeInfo type_info = {
+			.class_size = sizeof(struct gst_drm_comp_sink_class),
+			.class_init = class_init,
+			.base_init = base_init,
+			.instance_size = sizeof(struct gst_drm_comp_sink),
+			.instance_init = instance_init,
+		};
+
+		type = g_type_register_static(GST_TYPE_ELEMENT, "GstDrmCompSink", &type_info, 0);
+	}
+
+	return type;
+}
+
+static gboolean
+plugin_init(GstPlugin *plugin)
+{
+#ifndef GST_DISABLE_GST_DEBUG
+	drm_debug = _gst_debug_category_new("drmsink", 0, "drmsink");
+#endif
+
+	log_init();
+
+	convert_init();
+	copy_init();
+
+	if (!gst_element_register(plugin, "drmcompsink", GST_RANK_NONE, GST_DRMCOMP_SINK_TYPE))
+		return false;
+
+	return true;
+}
+
+GstPluginDesc gst_plugin_desc = {
+	.major_version = GST_VERSION_MAJOR,
+	.minor_version = GST_VERSION_MINOR,
+	.name = "drmcompsink",
+	.description = (gchar *) "Linux DRM sink compositing on planes",
+	.plugin_init = plugin_init,
+	.version = VERSION,
+	.license = "LGPL",
+	.source = "source",
+	.package = "package",
+	.origin = "origin",
+};
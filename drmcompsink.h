@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef DRMCOMPSINK_H
+#define DRMCOMPSINK_H
+
+#include <glib-object.h>
+
+#define GST_DRMCOMP_SINK_TYPE (gst_drmcomp_sink_get_type())
+#define GST_DRMCOMP_PAD_TYPE (gst_drmcomp_pad_get_type())
+
+GType gst_drmcomp_sink_get_type(void);
+GType gst_drmcomp_pad_get_type(void);
+
+#define DEFAULT_PROP_BUFFERS	3
+#define DEFAULT_PROP_BACKEND	BACKEND_AUTO
+#define DEFAULT_PROP_POOL_LIMIT	64	/* MiB */
+#define DEFAULT_PROP_SYNC	true
+
+#define DEFAULT_PROP_FILE	"/dev/dri/card0"
+
+/* pads */
+#define DEFAULT_PROP_PAD_POS	0
+#define DEFAULT_PROP_PAD_SIZE	0	/* the video size */
+#define DEFAULT_PROP_PAD_ZORDER	-1	/* the driver's */
+
+#endif /* DRMCOMPSINK_H */
@@ -23,10 +23,23 @@
 
 #include <xf86drmMode.h>
 #include <xf86drm.h>
-#include <libkms.h>
 
 #include "drmplanesink.h"
+#include "ring.h"
+#include "present.h"
+#include "format.h"
+#include "convert.h"
+#include "upload.h"
+#include "copy.h"
+#include "damage.h"
+#include "atomic.h"
+#include "pool.h"
+#include "prime.h"
+#include "stats.h"
 #include "log.h"
+#include "device.h"
+#include "pacing.h"
+#include "render.h"
 
 #define ROUND_UP(num, scale) (((num) + ((scale) - 1)) & ~((scale) - 1))
 
@@ -42,7 +55,20 @@ enum {
 	PROP_CRTC,
 	PROP_POSX,
 	PROP_POSY,
+	PROP_WIDTH,
+	PROP_HEIGHT,
+	PROP_FIT,
 	PROP_FILE,
+	PROP_BUFFERS,
+	PROP_UPLOAD_THREADS,
+	PROP_DAMAGE,
+	PROP_BACKEND,
+	PROP_POOL_LIMIT,
+	PROP_IMPORT,
+	PROP_EXPORT,
+	PROP_STATS,
+	PROP_STATS_INTERVAL,
+	PROP_PACING,
 };
 
 struct gst_drm_sink {
@@ -50,74 +76,261 @@ struct gst_drm_sink {
 
 	bool enabled;
 
-	struct kms_driver *drv;
+	/* pages, presentation and what they need, shared with drmsink */
+	struct render render;
 
-	unsigned char *frame[2];
-	struct kms_bo *bo[2];
-	uint32_t stride[2];
-	uint32_t fb[2];
+	unsigned int pool_limit;	/* MiB */
+	size_t pool_share;		/* bytes added to the pool's limit */
 
-	uint32_t current;
+	/* upstream dma-bufs scanned out without a copy */
+	bool use_import;
+
+	/* our buffers offered to upstream as dma-bufs too */
+	bool use_export;
+
+	unsigned int stats_interval;	/* ms between messages, 0 for none */
+
+	enum drm_backend backend;
+	struct atomic *atomic;		/* NULL with the legacy backend */
+
+	unsigned int nr_buffers;
+	unsigned int upload_threads;
+
+	/* frames held for the vblank closest to their clock time */
+	bool pacing;
+
+	/* only changed rows are uploaded, unchanged frames are not shown */
+	bool use_damage;
+
+	/* the refresh of the crtc, no point in more frames than that */
+	unsigned int max_framerate;
+
+	/* formats the plane can scan out, from drmModeGetPlane() */
+	uint32_t *plane_formats;
+	uint32_t nr_plane_formats;
 
 	gchar *device;
 
-	uint32_t width;
-	uint32_t height;
 	uint32_t posx;
 	uint32_t posy;
 
+	/* destination box requested by the user, 0 means the video size */
+	uint32_t dst_width;
+	uint32_t dst_height;
+	enum drmplane_fit fit;
+
+	/* plane geometry, source rectangle in 16.16 fixed point */
+	int32_t crtc_x, crtc_y;
+	uint32_t crtc_w, crtc_h;
+	uint32_t src_x, src_y;
+	uint32_t src_w, src_h;
+
 	uint32_t plane_id;
 	uint32_t crtc_id;
 
-	int fd;
+	struct device *dev;
 };
 
 struct gst_drm_sink_class {
 	GstBaseSinkClass parent_class;
 };
 
+#define GST_DRMPLANE_FIT_TYPE (gst_drmplane_fit_get_type())
+
+static GType
+gst_drmplane_fit_get_type(void)
+{
+	static GType type;
+
+	if (G_UNLIKELY(type == 0)) {
+		static const GEnumValue values[] = {
+			{ FIT_STRETCH, "Stretch to the destination box", "stretch" },
+			{ FIT_LETTERBOX, "Keep aspect ratio, fit inside the box", "letterbox" },
+			{ FIT_CROP, "Keep aspect ratio, crop to fill the box", "crop" },
+			{ 0, NULL, NULL },
+		};
+
+		type = g_enum_register_static("GstDrmPlaneFit", values);
+	}
+
+	return type;
+}
+
+#define GST_DRMPLANE_BACKEND_TYPE (gst_drmplane_backend_get_type())
+
+static GType
+gst_drmplane_backend_get_type(void)
+{
+	static GType type;
+
+	if (G_UNLIKELY(type == 0)) {
+		static const GEnumValue values[] = {
+			{ BACKEND_AUTO, "Atomic when available, legacy otherwise", "auto" },
+			{ BACKEND_LEGACY, "Legacy SetPlane", "legacy" },
+			{ BACKEND_ATOMIC, "Non-blocking atomic commits", "atomic" },
+			{ 0, NULL, NULL },
+		};
+
+		type = g_enum_register_static("GstDrmPlaneBackend", values);
+	}
+
+	return type;
+}
+
 static GstCaps *
 generate_sink_template(void)
 {
 	GstCaps *caps;
-	GstStructure *struc;
+	unsigned int i;
 
 	caps = gst_caps_new_empty();
 
-	struc = gst_structure_new("video/x-raw-rgb",
-			"width", GST_TYPE_INT_RANGE, 16, 4096,
-			"height", GST_TYPE_INT_RANGE, 16, 4096,
-			"bpp", G_TYPE_INT, 32,
-			"depth", G_TYPE_INT, 24,
-			"endianness", G_TYPE_INT, 4321,
-			"green_mask", G_TYPE_INT, 16711680,
-			"red_mask", G_TYPE_INT, 65280,
-			"blue_mask", G_TYPE_INT, -16777216,
-			"framerate", GST_TYPE_FRACTION_RANGE, 0, 1, 30, 1,
-			NULL);
-
-	gst_caps_append_structure(caps, struc);
+	for (i = 0; i < nr_formats; i++)
+		gst_caps_append_structure(caps, format_to_structure(&formats[i], FORMAT_MAX_FRAMERATE));
 
 	return caps;
 }
 
-static gboolean
-setup(struct gst_drm_sink *self, GstCaps *caps)
+static bool
+plane_supports(struct gst_drm_sink *self, const struct format *format)
 {
-	GstStructure *structure;
-	int width, height;
-	int ret, i;
+	uint32_t i;
+
+	for (i = 0; i < self->nr_plane_formats; i++)
+		if (self->plane_formats[i] == format->drm_format)
+			return true;
+
+	return false;
+}
+
+static bool
+can_convert(struct gst_drm_sink *self, const struct format *format)
+{
+	return convert_supported(format) && plane_supports(self, &formats[0]);
+}
+
+/* only offer what the plane can scan out, directly or after conversion */
+static GstCaps *
+get_caps(GstBaseSink *base)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
+	GstCaps *caps;
+	unsigned int i;
 
-	uint32_t stride;
-	uint32_t handle;
+	if (!self->plane_formats)
+		return NULL;
 
-	uint32_t attr[] = {
-		KMS_WIDTH, 0,
-		KMS_HEIGHT, 0,
-		KMS_BO_TYPE, KMS_BO_TYPE_SCANOUT_X8R8G8B8,
-		KMS_TERMINATE_PROP_LIST
+	caps = gst_caps_new_empty();
+
+	for (i = 0; i < nr_formats; i++)
+		if (plane_supports(self, &formats[i]) || can_convert(self, &formats[i]))
+			gst_caps_append_structure(caps, format_to_structure(&formats[i], self->max_framerate));
+
+	return caps;
+}
+
+/* let the display controller scale the video into the destination box */
+static void
+compute_geometry(struct gst_drm_sink *self)
+{
+	uint32_t sw = self->render.width, sh = self->render.height;
+	uint32_t dw = self->dst_width ? self->dst_width : sw;
+	uint32_t dh = self->dst_height ? self->dst_height : sh;
+	bool wider = (uint64_t) sw * dh > (uint64_t) dw * sh;
+
+	self->crtc_x = self->posx;
+	self->crtc_y = self->posy;
+	self->crtc_w = dw;
+	self->crtc_h = dh;
+
+	self->src_x = 0;
+	self->src_y = 0;
+	self->src_w = sw << 16;
+	self->src_h = sh << 16;
+
+	switch (self->fit) {
+	case FIT_LETTERBOX:
+		if (wider)
+			self->crtc_h = (uint64_t) sh * dw / sw;
+		else
+			self->crtc_w = (uint64_t) sw * dh / sh;
+		self->crtc_x += (dw - self->crtc_w) / 2;
+		self->crtc_y += (dh - self->crtc_h) / 2;
+		break;
+	case FIT_CROP:
+		if (wider)
+			self->src_w = ((uint64_t) dw * sh << 16) / dh;
+		else
+			self->src_h = ((uint64_t) dh * sw << 16) / dw;
+		self->src_x = ((sw << 16) - self->src_w) / 2;
+		self->src_y = ((sh << 16) - self->src_h) / 2;
+		break;
+	case FIT_STRETCH:
+	default:
+		break;
+	}
+}
+
+static struct atomic_plane
+plane_state(struct gst_drm_sink *self, struct page *page)
+{
+	struct atomic_plane plane = {
+		.fb = page->fb,
+		.crtc_x = self->crtc_x,
+		.crtc_y = self->crtc_y,
+		.crtc_w = self->crtc_w,
+		.crtc_h = self->crtc_h,
+		.src_x = self->src_x,
+		.src_y = self->src_y,
+		.src_w = self->src_w,
+		.src_h = self->src_h,
 	};
 
+	return plane;
+}
+
+/* runs on the presentation thread */
+static bool
+flip(void *data, struct page *page)
+{
+	struct gst_drm_sink *self = data;
+	int ret;
+
+	if (self->atomic) {
+		struct atomic_plane plane = plane_state(self, page);
+
+		ret = atomic_flip(self->atomic, &plane,
+			DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, self->render.present);
+		if (ret) {
+			fprintf(stderr, "failed drmModeAtomicCommit(): %s\n", strerror(-ret));
+			return false;
+		}
+
+		return true;
+	}
+
+	ret = device_set_plane(self->dev, self->plane_id, self->crtc_id, page->fb, 0,
+		self->crtc_x, self->crtc_y, self->crtc_w, self->crtc_h,
+		self->src_x, self->src_y, self->src_w, self->src_h);
+
+	if (ret) {
+		fprintf(stderr, "cannot set plane\n");
+		return false;
+	}
+
+	return true;
+}
+
+/* everything that depends on the caps */
+static bool
+configure(struct gst_drm_sink *self, GstCaps *caps)
+{
+	GstStructure *structure;
+	const struct format *format, *scanout;
+	int width, height;
+	unsigned int i;
+	int ret;
+
 	/* */
 
 	structure = gst_caps_get_structure(caps, 0);
@@ -125,60 +338,175 @@ setup(struct gst_drm_sink *self, GstCaps *caps)
 	gst_structure_get_int(structure, "width", &width);
 	gst_structure_get_int(structure, "height", &height);
 
-	attr[1] = self->width = width;
-	attr[3] = self->height = height;
+	format = format_from_structure(structure);
+	if (!format) {
+		fprintf(stderr, "unknown format\n");
+		return false;
+	}
+
+	if (plane_supports(self, format)) {
+		scanout = format;
+	} else if (can_convert(self, format)) {
+		scanout = &formats[0];
+	} else {
+		fprintf(stderr, "plane can't scan out the negotiated format\n");
+		return false;
+	}
+
+	self->render.format = format;
+	self->render.convert = scanout != format;
+	self->render.width = width;
+	self->render.height = height;
+
+	format_gst_layout(format, width, height, &self->render.src_layout);
+
+	compute_geometry(self);
 
 	/* configure drm buffers */
 
-	for(i = 0; i < DRM_FRAMES; i++) {
+	ring_init(&self->render.ring, self->nr_buffers);
 
-		ret = kms_bo_create(self->drv, attr, &self->bo[i]);
-		if (ret) {
-			perror("failed kms_bo_create()");
-			return false;
-		}
+	for(i = 0; i < self->render.ring.count; i++) {
+		struct page *page = &self->render.ring.pages[i];
 
-		ret = kms_bo_get_prop(self->bo[i], KMS_PITCH, &stride);
-		if (ret) {
-			perror("failed kms_bo_get_prop(KMS_PITCH)");
-			return false;
-		}
+		page->buffer = pool_get(self->render.pool, scanout, width, height);
+		if (!page->buffer)
+			goto fail;
 
-		self->stride[i] = stride;
+		page->frame = page->buffer->frame;
+		page->stride = page->buffer->pitch;
+		page->fb = page->buffer->fb;
 
-		ret = kms_bo_get_prop(self->bo[i], KMS_HANDLE, &handle);
-		if (ret) {
-			perror("failed kms_bo_get_prop(KMS_HANDLE)");
-			return false;
-		}
+		format_bo_layout(scanout, width, height, page->stride, &self->render.layout);
+	}
 
-		ret = kms_bo_map(self->bo[i], (void **) &self->frame[i]);
-		if (ret) {
-			perror("failed kms_bo_map()");
-			return false;
-		}
+	/* upstream writes with GStreamer's default strides, so the scanout
+	 * buffer is usable directly only when its planes sit at the same place */
+	self->render.direct = !self->render.convert &&
+		format_layout_equal(&self->render.layout, &self->render.src_layout);
+	self->render.import = !self->render.convert;
 
-		ret = drmModeAddFB(self->fd, self->width, self->height, 24, 32, stride, handle, &self->fb[i]);
+	if (self->render.damage) {
+		damage_free(self->render.damage);
+		self->render.damage = NULL;
+	}
+
+	if (self->use_damage)
+		self->render.damage = damage_new(height, self->render.ring.count);
+
+	/* check the driver takes our format and scaling before streaming */
+	if (self->atomic) {
+		struct atomic_plane plane = plane_state(self, &self->render.ring.pages[0]);
+
+		ret = atomic_flip(self->atomic, &plane, DRM_MODE_ATOMIC_TEST_ONLY, NULL);
 		if (ret) {
-			perror("failed drmModeAddFB()");
-			return false;
+			fprintf(stderr, "plane configuration rejected: %s\n", strerror(-ret));
+			/* the presentation thread is already waiting for flip events */
+			if (self->backend == BACKEND_ATOMIC || self->render.present)
+				goto fail;
+
+			atomic_free(self->atomic);
+			self->atomic = NULL;
 		}
 	}
 
+	return true;
+
+fail:
+	/* the same caps again must not look configured */
+	render_put_pages(&self->render);
+	return false;
+}
+
+/* the vblanks are those of the mode somebody else set on the crtc */
+static void
+start_pacing(struct gst_drm_sink *self)
+{
+	drmModeCrtc *crtc;
+
+	if (!pacing_supported(self->dev))
+		return;
+
+	crtc = device_get_crtc(self->dev, self->crtc_id);
+	if (!crtc || !crtc->mode_valid) {
+		fprintf(stderr, "no mode on crtc %u, pacing disabled\n", self->crtc_id);
+		if (crtc)
+			drmModeFreeCrtc(crtc);
+		return;
+	}
+
+	present_set_pacing(self->render.present, &crtc->mode);
+	pacing_update_delay(&self->parent, self->render.present, &self->render.render_delay);
+	self->render.paced = true;
+
+	drmModeFreeCrtc(crtc);
+}
+
+static gboolean
+setup(struct gst_drm_sink *self, GstCaps *caps)
+{
+	if (!configure(self, caps))
+		return false;
+
+	/* atomic commits complete with a page flip event */
+	self->render.present = present_new(self->dev, &self->render.ring, flip, self->atomic != NULL, self);
+	if (!self->render.present)
+		return false;
+
+	present_set_stats(self->render.present, self->render.stats);
+
+	if (self->pacing)
+		start_pacing(self);
+
 	self->enabled = true;
-	self->current = 0;
 
 	return true;
 }
 
+/*
+ * New caps mid-stream: the plane keeps showing the last frame until the
+ * first frame in the new buffers replaces it, new geometry included.
+ */
+static gboolean
+reconfigure(struct gst_drm_sink *self, GstCaps *caps)
+{
+	present_drain(self->render.present);
+
+	render_retire_ring(&self->render);
+
+	return configure(self, caps);
+}
+
+static GstFlowReturn
+buffer_alloc(GstBaseSink *base, guint64 offset, guint size, GstCaps *caps, GstBuffer **buf)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
+
+	*buf = NULL;
+
+	if (!self->enabled) {
+		if (!setup(self, caps))
+			return GST_FLOW_OK;
+	} else if (!render_caps_match(&self->render, caps))
+		return GST_FLOW_OK;
+
+	*buf = render_buffer_alloc(&self->render, size, caps);
+
+	return GST_FLOW_OK;
+}
+
 static gboolean
 setcaps(GstBaseSink *base, GstCaps *caps)
 {
 	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
-	if (self->enabled)
+
+	if (!self->enabled)
+		return setup(self, caps);
+
+	if (render_caps_match(&self->render, caps))
 		return true;
 
-	return setup(self, caps);
+	return reconfigure(self, caps);
 }
 
 static void
@@ -200,9 +528,50 @@ get_property (GObject * object, guint prop_id,
 		case PROP_POSY:
 			g_value_set_int (value, self->posy);
 			break;
+		case PROP_WIDTH:
+			g_value_set_int (value, self->dst_width);
+			break;
+		case PROP_HEIGHT:
+			g_value_set_int (value, self->dst_height);
+			break;
+		case PROP_FIT:
+			g_value_set_enum (value, self->fit);
+			break;
 		case PROP_FILE:
 			g_value_set_string (value, self->device);
 			break;
+		case PROP_BUFFERS:
+			g_value_set_int (value, self->nr_buffers);
+			break;
+		case PROP_UPLOAD_THREADS:
+			g_value_set_int (value, self->upload_threads);
+			break;
+		case PROP_DAMAGE:
+			g_value_set_boolean (value, self->use_damage);
+			break;
+		case PROP_BACKEND:
+			g_value_set_enum (value, self->backend);
+			break;
+		case PROP_POOL_LIMIT:
+			g_value_set_int (value, self->pool_limit);
+			break;
+		case PROP_IMPORT:
+			g_value_set_boolean (value, self->use_import);
+			break;
+		case PROP_EXPORT:
+			g_value_set_boolean (value, self->use_export);
+			break;
+		case PROP_STATS:
+			GST_OBJECT_LOCK(self);
+			g_value_take_boxed (value, self->render.stats ? stats_structure(self->render.stats, "drmplanesink-stats", false) : NULL);
+			GST_OBJECT_UNLOCK(self);
+			break;
+		case PROP_STATS_INTERVAL:
+			g_value_set_int (value, self->stats_interval);
+			break;
+		case PROP_PACING:
+			g_value_set_boolean (value, self->pacing);
+			break;
 		default:
 			break;
 	}
@@ -227,12 +596,49 @@ set_property (GObject * object, guint prop_id,
 		case PROP_POSY:
 			self->posy = g_value_get_int (value);
 			break;
+		case PROP_WIDTH:
+			self->dst_width = g_value_get_int (value);
+			break;
+		case PROP_HEIGHT:
+			self->dst_height = g_value_get_int (value);
+			break;
+		case PROP_FIT:
+			self->fit = g_value_get_enum (value);
+			break;
 		case PROP_FILE:
+			g_free(self->device);
 			self->device = g_strdup (g_value_get_string (value));
 			if (self->device == NULL) {
 				self->device = g_strdup(DEFAULT_PROP_FILE);
 			}
 			break;
+		case PROP_BUFFERS:
+			self->nr_buffers = g_value_get_int (value);
+			break;
+		case PROP_UPLOAD_THREADS:
+			self->upload_threads = g_value_get_int (value);
+			break;
+		case PROP_DAMAGE:
+			self->use_damage = g_value_get_boolean (value);
+			break;
+		case PROP_BACKEND:
+			self->backend = g_value_get_enum (value);
+			break;
+		case PROP_POOL_LIMIT:
+			self->pool_limit = g_value_get_int (value);
+			break;
+		case PROP_IMPORT:
+			self->use_import = g_value_get_boolean (value);
+			break;
+		case PROP_EXPORT:
+			self->use_export = g_value_get_boolean (value);
+			break;
+		case PROP_STATS_INTERVAL:
+			self->stats_interval = g_value_get_int (value);
+			break;
+		case PROP_PACING:
+			self->pacing = g_value_get_boolean (value);
+			break;
 		default:
 			break;
 	}
@@ -244,27 +650,53 @@ start(GstBaseSink *base)
 	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
 	drmModePlane *plane = NULL;
 	drmModePlaneRes *resources;
+	drmModeCrtc *crtc;
 	uint32_t i;
-	int ret;
 
-	/* open drm device */
+	/* open drm device, or share it with other drmplanesinks */
 
-	self->fd = open(self->device, O_RDWR | O_CLOEXEC);
-	if (self->fd < 0) {
-		perror("cannot open drm device");
+	self->pool_share = (size_t) self->pool_limit << 20;
+	self->render.pool = pool_open(self->device, self->pool_share);
+	if (!self->render.pool)
 		return false;
+
+	self->dev = pool_device(self->render.pool);
+
+	if (self->use_import)
+		self->render.prime = pool_prime(self->render.pool);
+
+	self->render.export = self->use_export && prime_can_export(self->dev);
+
+	crtc = device_get_crtc(self->dev, self->crtc_id);
+	if (crtc && crtc->mode_valid)
+		self->max_framerate = (device_mode_refresh(&crtc->mode) + 999) / 1000;
+	else
+		self->max_framerate = FORMAT_MAX_FRAMERATE;
+	if (crtc)
+		drmModeFreeCrtc(crtc);
+
+	/* atomic modesetting, before the plane list: it adds universal planes */
+
+	if (self->backend != BACKEND_LEGACY && atomic_enable(self->dev))
+		self->atomic = atomic_new(self->dev->fd, self->crtc_id, 0, self->plane_id);
+
+	if (self->backend == BACKEND_ATOMIC && !self->atomic) {
+		fprintf(stderr, "atomic modesetting not available\n");
+		goto fail;
 	}
 
 	/* check drm plane */
 
-	resources = drmModeGetPlaneResources(self->fd);
+	resources = device_get_plane_resources(self->dev);
 	if (!resources || resources->count_planes == 0) {
 		fprintf(stderr, "drmModeGetPlaneResources failed\n");
-		return false;
+		if (resources)
+			drmModeFreePlaneResources(resources);
+		goto fail;
 	}
 
 	for (i = 0; i < resources->count_planes; i++) {
-		drmModePlane *p = drmModeGetPlane(self->fd, resources->planes[i]);
+		drmModePlane *p = device_get_plane(self->dev, resources->planes[i]);
 		if (!p)
 			continue;
 
@@ -273,79 +705,161 @@ start(GstBaseSink *base)
 			break;
 		}
 
-		drmModeFreePlane(plane);
+		drmModeFreePlane(p);
 	}
 
+	drmModeFreePlaneResources(resources);
+
 	if (!plane) {
 		fprintf(stderr, "couldn't find specified plane\n");
-		return false;
+		goto fail;
 	}
 
-	/* create libkms driver */
+	self->plane_formats = g_memdup(plane->formats, plane->count_formats * sizeof(*plane->formats));
+	self->nr_plane_formats = plane->count_formats;
 
-	ret = kms_create(self->fd, &self->drv);
-	if (ret) {
-		perror("failed kms_create()");
-		return false;
-	}
+	drmModeFreePlane(plane);
+
+	self->render.upload = upload_new(self->upload_threads);
+
+	GST_OBJECT_LOCK(self);
+	self->render.stats = stats_new();
+	GST_OBJECT_UNLOCK(self);
 
 	return true;
+
+	/* GstBaseSink doesn't stop() what failed to start() */
+fail:
+	if (self->atomic) {
+		atomic_free(self->atomic);
+		self->atomic = NULL;
+	}
+
+	self->render.prime = NULL;
+
+	pool_unref(self->render.pool, self->pool_share);
+	self->render.pool = NULL;
+	return false;
 }
 
 static gboolean
 stop(GstBaseSink *base)
 {
 	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
-	int i;
+	unsigned int i;
 
-	drmModeSetPlane(self->fd, self->plane_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	if (self->render.present) {
+		present_free(self->render.present);
+		self->render.present = NULL;
+	}
+
+	trace_dump();
+
+	self->enabled = false;
 
-	for(i = 0; i < DRM_FRAMES; i++) {
-		drmModeRmFB(self->fd, self->fb[i]);
-		kms_bo_unmap(self->bo[i]);
-		kms_bo_destroy(&self->bo[i]);
+	if (self->render.paced) {
+		gst_base_sink_set_render_delay(base, 0);
+		self->render.render_delay = 0;
+		self->render.paced = false;
 	}
 
-	kms_destroy(&self->drv);
+	device_set_plane(self->dev, self->plane_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 
-	close(self->fd);
+	for(i = 0; i < self->render.ring.count; i++) {
+		struct page *page = &self->render.ring.pages[i];
+
+		if (page->buffer)
+			pool_put(self->render.pool, page->buffer);
+		page->buffer = NULL;
+	}
+
+	render_release_retired(&self->render, true);
+	render_release_imports(&self->render, true);
+
+	self->render.prime = NULL;
+
+	if (self->atomic) {
+		atomic_free(self->atomic);
+		self->atomic = NULL;
+	}
+
+	if (self->render.damage) {
+		damage_free(self->render.damage);
+		self->render.damage = NULL;
+	}
+
+	upload_free(self->render.upload);
+	self->render.upload = NULL;
+
+	GST_OBJECT_LOCK(self);
+	stats_free(self->render.stats);
+	self->render.stats = NULL;
+	GST_OBJECT_UNLOCK(self);
+
+	g_free(self->plane_formats);
+	self->plane_formats = NULL;
+	self->nr_plane_formats = 0;
+
+	pool_unref(self->render.pool, self->pool_share);
+	self->render.pool = NULL;
 
 	return true;
 }
 
+/* periodic element message with the stats of the last interval */
+static void
+post_stats(struct gst_drm_sink *self)
+{
+	GstStructure *structure;
+
+	if (!self->stats_interval || !stats_window_elapsed(self->render.stats, self->stats_interval))
+		return;
+
+	structure = stats_structure(self->render.stats, "drmplanesink-stats", true);
+	gst_element_post_message(GST_ELEMENT(self), gst_message_new_element(GST_OBJECT(self), structure));
+}
+
 static GstFlowReturn
 render(GstBaseSink *base, GstBuffer *buffer)
 {
 	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
-	uint32_t current = self->current;
-	int ret;
 
-	if (GST_BUFFER_SIZE(buffer) < 4 * self->width * self->height) {
-		fprintf(stderr, "Incoming buffer is less than expected. Some negotiation problem occured...\n");
-		return GST_FLOW_ERROR;
-	}
+	post_stats(self);
 
-	{
-		uint8_t *dst = (uint8_t *) self->frame[current];
-		uint8_t *src = (uint8_t *) GST_BUFFER_DATA(buffer);
-		uint32_t s;
+	return render_frame(&self->render, buffer, self->render.paced ? pacing_target(base, buffer) : 0);
+}
 
-		for (s = 0; s < self->height; s++) {
-			memcpy(dst + s*self->stride[current], src + 4 * s * self->width, 4 * self->width);
-		}
-	}
+/* the clock isn't running yet, nothing to pace against */
+static GstFlowReturn
+preroll(GstBaseSink *base, GstBuffer *buffer)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
 
-	ret = drmModeSetPlane(self->fd, self->plane_id, self->crtc_id, self->fb[current], 0,
-		self->posx, self->posy, self->width, self->height, 0, 0, self->width << 16, self->height << 16);
+	post_stats(self);
 
-	if (ret) {
-		fprintf(stderr, "cannot set plane\n");
-		return GST_FLOW_ERROR;
-	}
+	return render_frame(&self->render, buffer, 0);
+}
 
-	self->current = current ^ 1;
+static gboolean
+unlock(GstBaseSink *base)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
 
-	return GST_FLOW_OK;
+	if (self->render.present)
+		present_set_flushing(self->render.present, true);
+
+	return true;
+}
+
+static gboolean
+unlock_stop(GstBaseSink *base)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
+
+	if (self->render.present)
+		present_set_flushing(self->render.present, false);
+
+	return true;
 }
 
 static void
@@ -378,15 +892,91 @@ class_init(void *g_class, void *class_data)
 			g_param_spec_int ("posy", "posy", "plane left top corner Y position",
 				0, 1024, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+	g_object_class_install_property (gobject_class, PROP_WIDTH,
+			g_param_spec_int ("width", "width", "plane width on screen (0 = video width)",
+				0, 4096, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_HEIGHT,
+			g_param_spec_int ("height", "height", "plane height on screen (0 = video height)",
+				0, 4096, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_FIT,
+			g_param_spec_enum ("fit", "fit", "how the video is fitted into the plane",
+				GST_DRMPLANE_FIT_TYPE, DEFAULT_PROP_FIT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
 	g_object_class_install_property (gobject_class, PROP_FILE,
-			g_param_spec_string ("device", "device", "DRM device",
+			g_param_spec_string ("device", "device", "DRM device, or memory[:WxH[@HZ]][,dump=FILE] for one in memory",
 				DEFAULT_PROP_FILE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+	g_object_class_install_property (gobject_class, PROP_BUFFERS,
+			g_param_spec_int ("buffers", "buffers", "Number of scanout buffers",
+				RING_MIN_PAGES, RING_MAX_PAGES, DEFAULT_PROP_BUFFERS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_UPLOAD_THREADS,
+			g_param_spec_int ("upload-threads", "upload-threads", "Number of threads copying each frame",
+				1, UPLOAD_MAX_THREADS, DEFAULT_PROP_UPLOAD_THREADS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_DAMAGE,
+			g_param_spec_boolean ("damage", "damage", "Upload only changed rows and skip unchanged frames",
+				DEFAULT_PROP_DAMAGE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_BACKEND,
+			g_param_spec_enum ("backend", "backend", "Modesetting interface",
+				GST_DRMPLANE_BACKEND_TYPE, DEFAULT_PROP_BACKEND, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_POOL_LIMIT,
+			g_param_spec_int ("pool-limit", "pool-limit", "MiB of idle scanout buffers kept for reuse, added to what other sinks of this kind on the device ask for",
+				0, 4096, DEFAULT_PROP_POOL_LIMIT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_IMPORT,
+			g_param_spec_boolean ("import", "import", "Scan out upstream dma-buf buffers without copying",
+				DEFAULT_PROP_IMPORT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_EXPORT,
+			g_param_spec_boolean ("export", "export", "Attach a dma-buf of the scanout buffer to buffers given upstream",
+				DEFAULT_PROP_EXPORT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_STATS,
+			g_param_spec_boxed ("stats", "stats", "Frame counters, copy rate, fps and latency percentiles",
+				GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+			g_param_spec_int ("stats-interval", "stats-interval", "Milliseconds between stats element messages (0 = none)",
+				0, 60000, DEFAULT_PROP_STATS_INTERVAL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_PACING,
+			g_param_spec_boolean ("pacing", "pacing", "Show each frame on the vblank closest to its clock time",
+				DEFAULT_PROP_PACING, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	base_sink_class->get_caps = get_caps;
 	base_sink_class->set_caps = setcaps;
 	base_sink_class->start = start;
 	base_sink_class->stop = stop;
 	base_sink_class->render = render;
-	base_sink_class->preroll = render;
+	base_sink_class->preroll = preroll;
+	base_sink_class->buffer_alloc = buffer_alloc;
+	base_sink_class->unlock = unlock;
+	base_sink_class->unlock_stop = unlock_stop;
+}
+
+static void
+instance_init(GTypeInstance *instance, void *g_class)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)instance;
+
+	self->render.sink = &self->parent;
+
+	self->device = g_strdup(DEFAULT_PROP_FILE);
+	self->nr_buffers = DEFAULT_PROP_BUFFERS;
+	self->upload_threads = DEFAULT_PROP_UPLOAD_THREADS;
+	self->use_damage = DEFAULT_PROP_DAMAGE;
+	self->backend = DEFAULT_PROP_BACKEND;
+	self->pool_limit = DEFAULT_PROP_POOL_LIMIT;
+	self->use_import = DEFAULT_PROP_IMPORT;
+	self->use_export = DEFAULT_PROP_EXPORT;
+	self->stats_interval = DEFAULT_PROP_STATS_INTERVAL;
+	self->pacing = DEFAULT_PROP_PACING;
+	self->fit = DEFAULT_PROP_FIT;
 }
 
 static void
@@ -421,6 +1011,7 @@ gst_drmplane_sink_get_type(void)
 			.class_init = class_init,
 			.base_init = base_init,
 			.instance_size = sizeof(struct gst_drm_sink),
+			.instance_init = instance_init,
 		};
 
 		type = g_type_register_static(GST_TYPE_BASE_SINK, "GstDrmPlaneSink", &type_info, 0);
@@ -436,6 +1027,11 @@ plugin_init(GstPlugin *plugin)
 	drm_debug = _gst_debug_category_new("drmsink", 0, "drmsink");
 #endif
 
+	log_init();
+
+	convert_init();
+	copy_init();
+
 	if (!gst_element_register(plugin, "drmplanesink", GST_RANK_SECONDARY, GST_DRMPLANE_SINK_TYPE))
 		return false;
 
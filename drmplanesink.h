@@ -16,8 +16,23 @@
 
 GType gst_drmplane_sink_get_type(void);
 
-#define DRM_FRAMES	2
+#define DEFAULT_PROP_BUFFERS	2
+#define DEFAULT_PROP_UPLOAD_THREADS	1
+#define DEFAULT_PROP_DAMAGE	false
+#define DEFAULT_PROP_BACKEND	BACKEND_AUTO
+#define DEFAULT_PROP_POOL_LIMIT	64	/* MiB */
+#define DEFAULT_PROP_IMPORT	true
+#define DEFAULT_PROP_EXPORT	true
+#define DEFAULT_PROP_STATS_INTERVAL	1000	/* ms */
+#define DEFAULT_PROP_PACING	false
 
 #define DEFAULT_PROP_FILE	"/dev/dri/card0"
+#define DEFAULT_PROP_FIT	FIT_STRETCH
+
+enum drmplane_fit {
+	FIT_STRETCH,
+	FIT_LETTERBOX,
+	FIT_CROP,
+};
 
 #endif /* DRMPLANESINK_H */
@@ -11,6 +11,7 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -23,13 +24,28 @@
 
 #include <xf86drmMode.h>
 #include <xf86drm.h>
-#include <libkms.h>
 
 #include "drmsink.h"
+#include "ring.h"
+#include "present.h"
+#include "format.h"
+#include "convert.h"
+#include "upload.h"
+#include "copy.h"
+#include "damage.h"
+#include "atomic.h"
+#include "pool.h"
+#include "prime.h"
+#include "stats.h"
 #include "log.h"
+#include "device.h"
+#include "pacing.h"
+#include "render.h"
 
 #define ROUND_UP(num, scale) (((num) + ((scale) - 1)) & ~((scale) - 1))
 
+#define MAX_HEADS	4
+
 static void *parent_class;
 
 #ifndef GST_DISABLE_GST_DEBUG
@@ -42,6 +58,40 @@ enum {
 	PROP_CRTC,
 	PROP_MODE,
 	PROP_FILE,
+	PROP_POSX,
+	PROP_POSY,
+	PROP_BUFFERS,
+	PROP_UPLOAD_THREADS,
+	PROP_DAMAGE,
+	PROP_BACKEND,
+	PROP_POOL_LIMIT,
+	PROP_IMPORT,
+	PROP_EXPORT,
+	PROP_STATS,
+	PROP_STATS_INTERVAL,
+	PROP_PACING,
+	PROP_MATCH_REFRESH,
+	PROP_CONNECTORS,
+	PROP_MULTI_HEAD,
+};
+
+/* what several connectors show */
+enum multi_head {
+	MULTI_HEAD_CLONE,	/* the same picture */
+	MULTI_HEAD_SPAN,	/* one part each, side by side */
+};
+
+/* a connector and the crtc driving it; all scan out the same framebuffer */
+struct head {
+	uint32_t conn_id;
+	uint32_t crtc_id;
+	/* the crtc already drives the connector */
+	bool bound;
+	/* restored on stop */
+	drmModeCrtcPtr saved_crtc;
+	struct atomic *atomic;
+	/* left edge of its part of the framebuffer */
+	uint32_t x;
 };
 
 struct gst_drm_sink {
@@ -49,76 +99,257 @@ struct gst_drm_sink {
 
 	bool enabled;
 
-	struct kms_driver *drv;
+	/* pages, presentation and what they need, shared with drmplanesink */
+	struct render render;
 
-	unsigned char *frame[2];
-	struct kms_bo *bo[2];
-	uint32_t stride[2];
-	uint32_t fb[2];
+	unsigned int pool_limit;	/* MiB */
+	size_t pool_share;		/* bytes added to the pool's limit */
 
-	uint32_t current;
+	/* upstream dma-bufs scanned out without a copy */
+	bool use_import;
 
-    drmModeCrtcPtr saved_crtc;
-	drmModeModeInfo *mode;
+	/* our buffers offered to upstream as dma-bufs too */
+	bool use_export;
+
+	unsigned int stats_interval;	/* ms between messages, 0 for none */
+
+	enum drm_backend backend;
+	bool use_atomic;		/* every head has its atomic state */
+
+	unsigned int nr_buffers;
+	unsigned int upload_threads;
+
+	/* frames held for the vblank closest to their clock time */
+	bool pacing;
+
+	/* only changed rows are uploaded, unchanged frames are not flipped */
+	bool use_damage;
+
+	drmModeModeInfo mode;
+	/* the crtcs already show the mode on our connectors, no modeset */
+	bool keep_mode;
+	/* all the connectors have, for match-refresh */
+	drmModeModeInfo *modes;
+	int nr_modes;
+	bool match_refresh;
 
 	gchar *mode_name;
 	gchar *device;
 
-	uint32_t width;
-	uint32_t height;
+	/* the screen: the mode, or the modes of all heads side by side */
+	uint32_t fb_width;
+	uint32_t fb_height;
 
-	uint32_t conn_id;
-	uint32_t crtc_id;
+	/* video position on screen, -1 centers it */
+	int posx;
+	int posy;
+
+	/* as set, 0 picks one; crtc is for the first head */
+	uint32_t req_conn_id;
+	uint32_t req_crtc_id;
+	gchar *connectors;		/* "ID,ID,...", overrides conn */
+	enum multi_head multi_head;
 
-	int fd;
+	struct head heads[MAX_HEADS];
+	unsigned int nr_heads;
+
+	struct device *dev;
 };
 
 struct gst_drm_sink_class {
 	GstBaseSinkClass parent_class;
 };
 
+#define GST_DRM_BACKEND_TYPE (gst_drm_backend_get_type())
+
+static GType
+gst_drm_backend_get_type(void)
+{
+	static GType type;
+
+	if (G_UNLIKELY(type == 0)) {
+		static const GEnumValue values[] = {
+			{ BACKEND_AUTO, "Atomic when available, legacy otherwise", "auto" },
+			{ BACKEND_LEGACY, "Legacy SetCrtc and PageFlip", "legacy" },
+			{ BACKEND_ATOMIC, "Atomic commits", "atomic" },
+			{ 0, NULL, NULL },
+		};
+
+		type = g_enum_register_static("GstDrmSinkBackend", values);
+	}
+
+	return type;
+}
+
+#define GST_DRM_MULTI_HEAD_TYPE (gst_drm_multi_head_get_type())
+
+static GType
+gst_drm_multi_head_get_type(void)
+{
+	static GType type;
+
+	if (G_UNLIKELY(type == 0)) {
+		static const GEnumValue values[] = {
+			{ MULTI_HEAD_CLONE, "The same picture on every connector", "clone" },
+			{ MULTI_HEAD_SPAN, "One picture across the connectors, left to right", "span" },
+			{ 0, NULL, NULL },
+		};
+
+		type = g_enum_register_static("GstDrmSinkMultiHead", values);
+	}
+
+	return type;
+}
+
 static GstCaps *
-generate_sink_template(void)
+sink_caps(int max_framerate)
 {
 	GstCaps *caps;
-	GstStructure *struc;
+	unsigned int i;
 
 	caps = gst_caps_new_empty();
 
-	struc = gst_structure_new("video/x-raw-rgb",
-			"width", GST_TYPE_INT_RANGE, 16, 4096,
-			"height", GST_TYPE_INT_RANGE, 16, 4096,
-			"bpp", G_TYPE_INT, 32,
-			"depth", G_TYPE_INT, 24,
-			"endianness", G_TYPE_INT, 4321,
-			"green_mask", G_TYPE_INT, 16711680,
-			"red_mask", G_TYPE_INT, 65280,
-			"blue_mask", G_TYPE_INT, -16777216,
-			"framerate", GST_TYPE_FRACTION_RANGE, 0, 1, 30, 1,
-			NULL);
-
-	gst_caps_append_structure(caps, struc);
+	/* the primary plane only scans out xRGB, YUV is converted on upload */
+	for (i = 0; i < nr_formats; i++)
+		if (!formats[i].fourcc || convert_supported(&formats[i]))
+			gst_caps_append_structure(caps, format_to_structure(&formats[i], max_framerate));
 
 	return caps;
 }
 
-static gboolean
-setup(struct gst_drm_sink *self, GstCaps *caps)
+static GstCaps *
+generate_sink_template(void)
 {
-	GstStructure *structure;
-	int width, height;
-	int ret, i;
-
-	uint32_t stride;
-	uint32_t handle;
+	return sink_caps(FORMAT_MAX_FRAMERATE);
+}
 
-	uint32_t attr[] = {
-		KMS_WIDTH, 0,
-		KMS_HEIGHT, 0,
-		KMS_BO_TYPE, KMS_BO_TYPE_SCANOUT_X8R8G8B8,
-		KMS_TERMINATE_PROP_LIST
+/* the head's mode sized part of the buffer on its primary plane */
+static struct atomic_plane
+primary_plane(struct gst_drm_sink *self, struct head *head, struct page *page)
+{
+	struct atomic_plane plane = {
+		.fb = page->fb,
+		.crtc_w = self->mode.hdisplay,
+		.crtc_h = self->mode.vdisplay,
+		.src_x = head->x << 16,
+		.src_w = self->mode.hdisplay << 16,
+		.src_h = self->mode.vdisplay << 16,
 	};
 
+	return plane;
+}
+
+static void
+free_atomic(struct gst_drm_sink *self)
+{
+	unsigned int i;
+
+	for (i = 0; i < self->nr_heads; i++) {
+		if (self->heads[i].atomic)
+			atomic_free(self->heads[i].atomic);
+		self->heads[i].atomic = NULL;
+	}
+
+	self->use_atomic = false;
+}
+
+/* runs on the presentation thread */
+static bool
+flip(void *data, struct page *page)
+{
+	struct gst_drm_sink *self = data;
+	/* imported pages carry no damage */
+	unsigned int index = page->buffer ? page - self->render.ring.pages : 0;
+	unsigned int nr_clips = page->buffer ? self->render.nr_clips[index] : 0;
+	unsigned int i;
+	int ret;
+
+	if (self->use_atomic) {
+		struct atomic *atomics[MAX_HEADS];
+		struct atomic_plane planes[MAX_HEADS];
+
+		for (i = 0; i < self->nr_heads; i++) {
+			atomics[i] = self->heads[i].atomic;
+			planes[i] = primary_plane(self, &self->heads[i], page);
+		}
+
+		/* every crtc at its next vblank, each sends an event */
+		ret = atomic_commit(atomics, planes, self->nr_heads,
+			DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, self->render.present);
+		if (ret) {
+			fprintf(stderr, "failed drmModeAtomicCommit(): %s\n", strerror(-ret));
+			return false;
+		}
+	} else {
+		/* the crtcs keep their x offset into the framebuffer */
+		for (i = 0; i < self->nr_heads; i++) {
+			ret = device_page_flip(self->dev, self->heads[i].crtc_id, page->fb,
+				DRM_MODE_PAGE_FLIP_EVENT, self->render.present);
+			if (ret) {
+				perror("failed drmModePageFlip()");
+				return false;
+			}
+		}
+	}
+
+	/* no clips means the whole framebuffer */
+	device_dirty_fb(self->dev, page->fb, nr_clips ? self->render.clips[index] : NULL, nr_clips);
+
+	return true;
+}
+
+static bool
+modeset(struct gst_drm_sink *self, struct page *page)
+{
+	struct head *head;
+	unsigned int i;
+	int ret;
+
+	if (self->use_atomic) {
+		struct atomic *atomics[MAX_HEADS];
+		struct atomic_plane planes[MAX_HEADS];
+
+		for (i = 0; i < self->nr_heads; i++) {
+			atomics[i] = self->heads[i].atomic;
+			planes[i] = primary_plane(self, &self->heads[i], page);
+		}
+
+		/* all heads are checked before any changes */
+		ret = atomic_modeset(atomics, &self->mode, planes, self->nr_heads);
+		if (!ret)
+			return true;
+
+		fprintf(stderr, "atomic modeset failed: %s\n", strerror(-ret));
+		if (self->backend == BACKEND_ATOMIC)
+			return false;
+
+		/* auto: the driver may still take the same configuration the old way */
+		free_atomic(self);
+	}
+
+	for (i = 0; i < self->nr_heads; i++) {
+		head = &self->heads[i];
+
+		ret = device_set_crtc(self->dev, head->crtc_id, page->fb,
+			head->x, 0, &head->conn_id, 1, &self->mode);
+		if (ret) {
+			perror("failed drmModeSetCrtc(initial)");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* everything that depends on the caps */
+static bool
+configure(struct gst_drm_sink *self, GstCaps *caps)
+{
+	GstStructure *structure;
+	int width, height;
+	unsigned int i;
+	int x, y;
+
 	/* */
 
 	structure = gst_caps_get_structure(caps, 0);
@@ -126,76 +357,282 @@ setup(struct gst_drm_sink *self, GstCaps *caps)
 	gst_structure_get_int(structure, "width", &width);
 	gst_structure_get_int(structure, "height", &height);
 
-	if (width > self->mode->hdisplay || height > self->mode->vdisplay) {
+	self->fb_width = self->mode.hdisplay;
+	self->fb_height = self->mode.vdisplay;
+
+	if (self->multi_head == MULTI_HEAD_SPAN)
+		self->fb_width *= self->nr_heads;
+
+	for (i = 0; i < self->nr_heads; i++)
+		self->heads[i].x = self->multi_head == MULTI_HEAD_SPAN ? i * self->mode.hdisplay : 0;
+
+	if ((uint32_t) width > self->fb_width || (uint32_t) height > self->fb_height) {
 		fprintf(stderr, "incoming image is far too big: %dx%d\n", width, height);
 		return false;
 	}
 
-	self->width = width;
-	self->height = height;
+	self->render.format = format_from_structure(structure);
+	if (!self->render.format) {
+		fprintf(stderr, "unknown format\n");
+		return false;
+	}
+
+	self->render.width = width;
+	self->render.height = height;
+	/* the pages are xRGB, anything else is converted on the way */
+	self->render.convert = self->render.format->fourcc != 0;
+	/* the primary planes need a screen sized xRGB framebuffer */
+	self->render.import = !self->render.convert &&
+		(uint32_t) width == self->fb_width && (uint32_t) height == self->fb_height;
+
+	format_gst_layout(self->render.format, width, height, &self->render.src_layout);
+
+	x = self->posx < 0 ? ((int) self->fb_width - width) / 2 : MIN(self->posx, (int) self->fb_width - width);
+	y = self->posy < 0 ? ((int) self->fb_height - height) / 2 : MIN(self->posy, (int) self->fb_height - height);
 
-	attr[1] = self->mode->hdisplay;
-	attr[3] = self->mode->vdisplay;
+	self->render.x = x;
+	self->render.y = y;
 
 	/* configure drm buffers */
 
-	for(i = 0; i < DRM_FRAMES; i++) {
+	ring_init(&self->render.ring, self->nr_buffers);
 
-		ret = kms_bo_create(self->drv, attr, &self->bo[i]);
-		if (ret) {
-			perror("failed kms_bo_create()");
-			return false;
-		}
+	for(i = 0; i < self->render.ring.count; i++) {
+		struct page *page = &self->render.ring.pages[i];
 
-		ret = kms_bo_get_prop(self->bo[i], KMS_PITCH, &stride);
-		if (ret) {
-			perror("failed kms_bo_get_prop(KMS_PITCH)");
+		/* screen sized: SetCrtc wants a framebuffer covering the whole mode,
+		 * every head scans out of the same one */
+		page->buffer = pool_get(self->render.pool, &formats[0],
+				self->fb_width, self->fb_height);
+		if (!page->buffer) {
+			render_put_pages(&self->render);
 			return false;
 		}
 
-		self->stride[i] = stride;
+		page->frame = page->buffer->frame;
+		page->stride = page->buffer->pitch;
+		page->fb = page->buffer->fb;
 
-		ret = kms_bo_get_prop(self->bo[i], KMS_HANDLE, &handle);
-		if (ret) {
-			perror("failed kms_bo_get_prop(KMS_HANDLE)");
-			return false;
-		}
+		format_bo_layout(&formats[0], width, height, page->stride, &self->render.layout);
+		self->render.layout.offset[0] = y * page->stride + x * 4;
 
-		ret = kms_bo_map(self->bo[i], (void **) &self->frame[i]);
-		if (ret) {
-			perror("failed kms_bo_map()");
-			return false;
+		/* the border around the video is never written again */
+		memset(page->frame, 0, page->stride * self->fb_height);
+	}
+
+	/* upstream can only write packed xRGB rows, so the scanout buffer is
+	 * usable directly only when its pitch matches the frame width */
+	self->render.direct = !self->render.convert &&
+		self->render.ring.pages[0].stride == 4 * (uint32_t) width;
+
+	if (self->render.damage) {
+		damage_free(self->render.damage);
+		self->render.damage = NULL;
+	}
+
+	if (self->use_damage)
+		self->render.damage = damage_new(height, self->render.ring.count);
+
+	return true;
+}
+
+static bool
+same_timings(const drmModeModeInfo *a, const drmModeModeInfo *b)
+{
+	return a->clock == b->clock &&
+		a->hdisplay == b->hdisplay && a->hsync_start == b->hsync_start &&
+		a->hsync_end == b->hsync_end && a->htotal == b->htotal &&
+		a->vdisplay == b->vdisplay && a->vsync_start == b->vsync_start &&
+		a->vsync_end == b->vsync_end && a->vtotal == b->vtotal &&
+		a->flags == b->flags;
+}
+
+static bool
+same_size(const drmModeModeInfo *a, const drmModeModeInfo *b)
+{
+	return a->hdisplay == b->hdisplay && a->vdisplay == b->vdisplay &&
+		(a->flags & DRM_MODE_FLAG_INTERLACE) == (b->flags & DRM_MODE_FLAG_INTERLACE);
+}
+
+/* how far the frame rate is from an even cadence: 0 for every frame n vblanks */
+static double
+cadence_error(const drmModeModeInfo *mode, double fps)
+{
+	double ratio = device_mode_refresh(mode) / 1000.0 / fps;
+	int n = ratio + 0.5;
+
+	/* slower than the stream, frames get dropped */
+	if (ratio < 1.0)
+		return 1.5 - ratio;
+
+	return ratio > n ? ratio - n : n - ratio;
+}
+
+/*
+ * Among the modes as large as the selected one, the refresh that is the
+ * closest to a whole multiple of the stream's frame rate: 24 fps goes to
+ * 48 or 72 Hz instead of 60 Hz and its 3:2 cadence, 50 fps to 50 Hz. The
+ * selected mode wins ties, then the connector's order.
+ */
+static void
+match_refresh(struct gst_drm_sink *self, GstCaps *caps)
+{
+	const drmModeModeInfo *best = NULL;
+	double fps, err, best_err;
+	int fps_n, fps_d, i;
+	unsigned int h;
+
+	if (!gst_structure_get_fraction(gst_caps_get_structure(caps, 0), "framerate", &fps_n, &fps_d) ||
+			fps_n <= 0 || fps_d <= 0)
+		return;
+
+	fps = (double) fps_n / fps_d;
+	best_err = cadence_error(&self->mode, fps);
+
+	for (i = 0; i < self->nr_modes; i++) {
+		if (!same_size(&self->modes[i], &self->mode))
+			continue;
+
+		/* within a frame every few hundred counts as even */
+		err = cadence_error(&self->modes[i], fps);
+		if (err < best_err - 0.005) {
+			best = &self->modes[i];
+			best_err = err;
 		}
+	}
 
-		ret = drmModeAddFB(self->fd, self->mode->hdisplay, self->mode->vdisplay, 24, 32, stride, handle, &self->fb[i]);
-		if (ret) {
-			perror("failed drmModeAddFB()");
+	if (!best)
+		return;
+
+	self->mode = *best;
+
+	for (h = 0; h < self->nr_heads; h++)
+		self->keep_mode = self->keep_mode && same_timings(&self->mode, &self->heads[h].saved_crtc->mode);
+}
+
+static gboolean
+setup(struct gst_drm_sink *self, GstCaps *caps)
+{
+	struct page *page;
+
+	/* the mode is final once it's set, later caps only get what it has */
+	if (self->match_refresh)
+		match_refresh(self, caps);
+
+	if (!configure(self, caps))
+		return false;
+
+	/*
+	 * The only modeset: later frames are presented with page flips. When
+	 * the mode is already up, e.g. behind a boot splash, even the first
+	 * frame is flipped in and the screen never blanks.
+	 */
+
+	if (!self->keep_mode) {
+		page = ring_get_free(&self->render.ring);
+
+		if (!modeset(self, page))
 			return false;
-		}
+
+		ring_set_state(page, PAGE_SCANOUT);
 	}
 
-	/* store current crtc */
+	self->render.present = present_new(self->dev, &self->render.ring, flip, true, self);
+	if (!self->render.present)
+		return false;
 
-    self->saved_crtc = drmModeGetCrtc(self->fd, self->crtc_id);
-    if (self->saved_crtc == NULL) {
-		perror("failed drmModeGetCrtc(current)");
-        return false;
-    }
+	present_set_stats(self->render.present, self->render.stats);
+	present_set_events(self->render.present, self->nr_heads);
+
+	if (self->pacing && pacing_supported(self->dev)) {
+		present_set_pacing(self->render.present, &self->mode);
+		pacing_update_delay(&self->parent, self->render.present, &self->render.render_delay);
+		self->render.paced = true;
+	}
 
 	self->enabled = true;
-	self->current = 0;
 
 	return true;
 }
 
+/*
+ * New caps mid-stream. The mode stays, so no modeset: the last frame stays
+ * on screen until the first frame in the new buffers is flipped in.
+ */
+static gboolean
+reconfigure(struct gst_drm_sink *self, GstCaps *caps)
+{
+	present_drain(self->render.present);
+
+	render_retire_ring(&self->render);
+
+	return configure(self, caps);
+}
+
+/*
+ * Up to the refresh of the mode, the frames beyond it would never make it
+ * to the screen. Before the modeset, match-refresh may go up to the fastest
+ * mode of the same size. Spanning heads take pictures as wide as all of them.
+ */
+static GstCaps *
+get_caps(GstBaseSink *base)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
+	unsigned int refresh, n;
+	GstCaps *caps;
+	int i;
+
+	if (!self->modes)
+		return NULL;
+
+	refresh = device_mode_refresh(&self->mode);
+
+	if (self->match_refresh && !self->enabled)
+		for (i = 0; i < self->nr_modes; i++)
+			if (same_size(&self->modes[i], &self->mode))
+				refresh = MAX(refresh, device_mode_refresh(&self->modes[i]));
+
+	caps = sink_caps((refresh + 999) / 1000);
+
+	if (self->multi_head == MULTI_HEAD_SPAN && self->nr_heads > 1)
+		for (n = 0; n < gst_caps_get_size(caps); n++)
+			gst_structure_set(gst_caps_get_structure(caps, n),
+					"width", GST_TYPE_INT_RANGE, 16, self->mode.hdisplay * self->nr_heads,
+					NULL);
+
+	return caps;
+}
+
+static GstFlowReturn
+buffer_alloc(GstBaseSink *base, guint64 offset, guint size, GstCaps *caps, GstBuffer **buf)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
+
+	*buf = NULL;
+
+	if (!self->enabled) {
+		if (!setup(self, caps))
+			return GST_FLOW_OK;
+	} else if (!render_caps_match(&self->render, caps))
+		return GST_FLOW_OK;
+
+	*buf = render_buffer_alloc(&self->render, size, caps);
+
+	return GST_FLOW_OK;
+}
+
 static gboolean
 setcaps(GstBaseSink *base, GstCaps *caps)
 {
 	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
-	if (self->enabled)
+
+	if (!self->enabled)
+		return setup(self, caps);
+
+	if (render_caps_match(&self->render, caps))
 		return true;
 
-	return setup(self, caps);
+	return reconfigure(self, caps);
 }
 
 static void
@@ -206,10 +643,10 @@ get_property (GObject * object, guint prop_id,
 
 	switch (prop_id) {
 		case PROP_CONN:
-			g_value_set_int (value, self->conn_id);
+			g_value_set_int (value, self->req_conn_id);
 			break;
 		case PROP_CRTC:
-			g_value_set_int (value, self->crtc_id);
+			g_value_set_int (value, self->req_crtc_id);
 			break;
 		case PROP_MODE:
 			g_value_set_string (value, self->mode_name);
@@ -217,6 +654,53 @@ get_property (GObject * object, guint prop_id,
 		case PROP_FILE:
 			g_value_set_string (value, self->device);
 			break;
+		case PROP_POSX:
+			g_value_set_int (value, self->posx);
+			break;
+		case PROP_POSY:
+			g_value_set_int (value, self->posy);
+			break;
+		case PROP_BUFFERS:
+			g_value_set_int (value, self->nr_buffers);
+			break;
+		case PROP_UPLOAD_THREADS:
+			g_value_set_int (value, self->upload_threads);
+			break;
+		case PROP_DAMAGE:
+			g_value_set_boolean (value, self->use_damage);
+			break;
+		case PROP_BACKEND:
+			g_value_set_enum (value, self->backend);
+			break;
+		case PROP_POOL_LIMIT:
+			g_value_set_int (value, self->pool_limit);
+			break;
+		case PROP_IMPORT:
+			g_value_set_boolean (value, self->use_import);
+			break;
+		case PROP_EXPORT:
+			g_value_set_boolean (value, self->use_export);
+			break;
+		case PROP_STATS:
+			GST_OBJECT_LOCK(self);
+			g_value_take_boxed (value, self->render.stats ? stats_structure(self->render.stats, "drmsink-stats", false) : NULL);
+			GST_OBJECT_UNLOCK(self);
+			break;
+		case PROP_STATS_INTERVAL:
+			g_value_set_int (value, self->stats_interval);
+			break;
+		case PROP_PACING:
+			g_value_set_boolean (value, self->pacing);
+			break;
+		case PROP_MATCH_REFRESH:
+			g_value_set_boolean (value, self->match_refresh);
+			break;
+		case PROP_CONNECTORS:
+			g_value_set_string (value, self->connectors);
+			break;
+		case PROP_MULTI_HEAD:
+			g_value_set_enum (value, self->multi_head);
+			break;
 		default:
 			break;
 	}
@@ -230,161 +714,576 @@ set_property (GObject * object, guint prop_id,
 
 	switch (prop_id) {
 		case PROP_CONN:
-			self->conn_id = g_value_get_int (value);
+			self->req_conn_id = g_value_get_int (value);
 			break;
 		case PROP_CRTC:
-			self->crtc_id = g_value_get_int (value);
+			self->req_crtc_id = g_value_get_int (value);
 			break;
 		case PROP_MODE:
+			g_free(self->mode_name);
 			self->mode_name = g_strdup (g_value_get_string (value));
 			if (self->mode_name == NULL) {
 				self->mode_name = g_strdup(DEFAULT_PROP_MODE);
 			}
 			break;
 		case PROP_FILE:
+			g_free(self->device);
 			self->device = g_strdup (g_value_get_string (value));
 			if (self->device == NULL) {
 				self->device = g_strdup(DEFAULT_PROP_FILE);
 			}
 			break;
+		case PROP_POSX:
+			self->posx = g_value_get_int (value);
+			break;
+		case PROP_POSY:
+			self->posy = g_value_get_int (value);
+			break;
+		case PROP_BUFFERS:
+			self->nr_buffers = g_value_get_int (value);
+			break;
+		case PROP_UPLOAD_THREADS:
+			self->upload_threads = g_value_get_int (value);
+			break;
+		case PROP_DAMAGE:
+			self->use_damage = g_value_get_boolean (value);
+			break;
+		case PROP_BACKEND:
+			self->backend = g_value_get_enum (value);
+			break;
+		case PROP_POOL_LIMIT:
+			self->pool_limit = g_value_get_int (value);
+			break;
+		case PROP_IMPORT:
+			self->use_import = g_value_get_boolean (value);
+			break;
+		case PROP_EXPORT:
+			self->use_export = g_value_get_boolean (value);
+			break;
+		case PROP_STATS_INTERVAL:
+			self->stats_interval = g_value_get_int (value);
+			break;
+		case PROP_PACING:
+			self->pacing = g_value_get_boolean (value);
+			break;
+		case PROP_MATCH_REFRESH:
+			self->match_refresh = g_value_get_boolean (value);
+			break;
+		case PROP_CONNECTORS:
+			g_free(self->connectors);
+			self->connectors = g_strdup (g_value_get_string (value));
+			break;
+		case PROP_MULTI_HEAD:
+			self->multi_head = g_value_get_enum (value);
+			break;
 		default:
 			break;
 	}
 }
 
-static gboolean
-start(GstBaseSink *base)
+/* what the kernel already knows; only a connector it never probed is probed */
+static drmModeConnector *
+get_connector(struct device *dev, uint32_t id)
 {
-	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
-	drmModeConnector *connector = NULL;
+	drmModeConnector *connector;
+
+	connector = device_get_connector_current(dev, id);
+	if (connector && !connector->count_modes && connector->connection != DRM_MODE_DISCONNECTED) {
+		drmModeFreeConnector(connector);
+		connector = device_get_connector(dev, id);
+	}
+
+	return connector;
+}
 
-    drmModeRes *resources;
-	drmModeModeInfo *mode;
+static int
+crtc_index(drmModeRes *resources, uint32_t crtc_id)
+{
+	int i;
 
-	int ret, i;
+	for (i = 0; i < resources->count_crtcs; i++)
+		if (resources->crtcs[i] == crtc_id)
+			return i;
 
-	/* open drm device */
+	return -1;
+}
 
-	self->fd = open(self->device, O_RDWR | O_CLOEXEC);
-	if (self->fd < 0) {
-		perror("cannot open drm device");
-		return false;
+/*
+ * The crtc already driving the connector, else the first it can use;
+ * none that another head has (taken, by index).
+ */
+static uint32_t
+pick_crtc(struct device *dev, drmModeRes *resources, drmModeConnector *connector, uint32_t taken, bool *bound)
+{
+	drmModeEncoder *encoder;
+	uint32_t possible = 0, crtc_id = 0;
+	int i, index;
+
+	*bound = false;
+
+	for (i = 0; i < connector->count_encoders; i++) {
+		encoder = device_get_encoder(dev, connector->encoders[i]);
+		if (!encoder)
+			continue;
+
+		index = crtc_index(resources, encoder->crtc_id);
+
+		if (encoder->encoder_id == connector->encoder_id && encoder->crtc_id &&
+				index >= 0 && !(taken & (1 << index))) {
+			crtc_id = encoder->crtc_id;
+			*bound = true;
+		}
+
+		possible |= encoder->possible_crtcs;
+		drmModeFreeEncoder(encoder);
+
+		if (crtc_id)
+			return crtc_id;
 	}
 
-	/* get drm mode */
+	possible &= ~taken;
 
-	resources = drmModeGetResources(self->fd);
-	if (!resources) {
-		fprintf(stderr, "drmModeGetResources failed\n");
+	for (i = 0; i < resources->count_crtcs; i++)
+		if (possible & (1 << i))
+			return resources->crtcs[i];
+
+	return 0;
+}
+
+/* "current" keeps what the crtc shows, "preferred" asks the monitor */
+static bool
+pick_mode(struct gst_drm_sink *self, drmModeConnector *connector)
+{
+	const drmModeModeInfo *mode = NULL;
+	int i;
+
+	if (strcmp(self->mode_name, "current") == 0 && self->heads[0].saved_crtc->mode_valid) {
+		self->mode = self->heads[0].saved_crtc->mode;
+		return true;
+	}
+
+	if (strcmp(self->mode_name, "preferred") == 0 || strcmp(self->mode_name, "current") == 0) {
+		for (i = 0; i < connector->count_modes && !mode; i++)
+			if (connector->modes[i].type & DRM_MODE_TYPE_PREFERRED)
+				mode = &connector->modes[i];
+		if (!mode && connector->count_modes)
+			mode = &connector->modes[0];
+	} else {
+		for (i = 0; i < connector->count_modes && !mode; i++)
+			if (strcmp(connector->modes[i].name, self->mode_name) == 0)
+				mode = &connector->modes[i];
+	}
+
+	if (!mode)
 		return false;
+
+	/* a copy, the connector goes away */
+	self->mode = *mode;
+
+	return true;
+}
+
+/* only what every head has, they all show the same mode */
+static void
+keep_common_modes(struct gst_drm_sink *self, drmModeConnector *connector)
+{
+	int i, j, n = 0;
+
+	for (i = 0; i < self->nr_modes; i++) {
+		for (j = 0; j < connector->count_modes; j++)
+			if (same_timings(&self->modes[i], &connector->modes[j]))
+				break;
+
+		if (j < connector->count_modes)
+			self->modes[n++] = self->modes[i];
 	}
 
+	self->nr_modes = n;
+}
+
+static bool
+has_mode(const drmModeModeInfo *modes, int nr_modes, const drmModeModeInfo *mode)
+{
+	int i;
+
+	for (i = 0; i < nr_modes; i++)
+		if (same_timings(&modes[i], mode))
+			return true;
+
+	return false;
+}
+
+/*
+ * Without probing a monitor if we can help it: the first connected
+ * connector when no id is given, and a crtc no other head has.
+ */
+static bool
+add_head(struct gst_drm_sink *self, drmModeRes *resources,
+		uint32_t req_conn_id, uint32_t req_crtc_id, uint32_t *taken)
+{
+	struct head *head = &self->heads[self->nr_heads];
+	drmModeConnector *connector = NULL;
+	int i;
+
 	for (i = 0; i < resources->count_connectors; i++) {
-		connector = drmModeGetConnector(self->fd, resources->connectors[i]);
+		if (req_conn_id && resources->connectors[i] != req_conn_id)
+			continue;
+
+		connector = get_connector(self->dev, resources->connectors[i]);
 		if (!connector)
 			continue;
 
-		if (connector->connector_id == self->conn_id)
+		if (req_conn_id ||
+				(connector->connection == DRM_MODE_CONNECTED && connector->count_modes))
 			break;
 
 		drmModeFreeConnector(connector);
+		connector = NULL;
 	}
 
-	if (i == resources->count_connectors) {
+	if (!connector) {
 		fprintf(stderr, "No proper connector found\n");
-		drmModeFreeResources(resources);
 		return false;
 	}
 
-    for (i = 0, mode = connector->modes; i < connector->count_modes; i++, mode++) {
-        if (0 == strcmp(mode->name, self->mode_name))
-            break;
-    }
+	head->conn_id = connector->connector_id;
+
+	head->crtc_id = pick_crtc(self->dev, resources, connector, *taken, &head->bound);
+	if (req_crtc_id) {
+		head->bound = head->bound && head->crtc_id == req_crtc_id;
+		head->crtc_id = req_crtc_id;
+	}
 
-	if (i == connector->count_modes) {
-        fprintf(stderr, "No selected mode\n");
+	if (!head->crtc_id || crtc_index(resources, head->crtc_id) < 0) {
+		fprintf(stderr, "No crtc for connector %u\n", head->conn_id);
 		drmModeFreeConnector(connector);
 		return false;
-    }
+	}
 
-	drmModeFreeResources(resources);
+	*taken |= 1 << crtc_index(resources, head->crtc_id);
+
+	head->saved_crtc = device_get_crtc(self->dev, head->crtc_id);
+	if (!head->saved_crtc) {
+		perror("failed drmModeGetCrtc(current)");
+		drmModeFreeConnector(connector);
+		return false;
+	}
 
-	self->mode = mode;
+	/* stop() restores it from here on */
+	self->nr_heads++;
+
+	if (self->nr_heads == 1) {
+		if (!pick_mode(self, connector)) {
+			fprintf(stderr, "No selected mode\n");
+			drmModeFreeConnector(connector);
+			return false;
+		}
 
-	/* create libkms driver */
+		self->modes = g_memdup(connector->modes, connector->count_modes * sizeof(*connector->modes));
+		self->nr_modes = connector->count_modes;
+	} else {
+		if (!has_mode(connector->modes, connector->count_modes, &self->mode)) {
+			fprintf(stderr, "connector %u can't show mode %s\n", head->conn_id, self->mode.name);
+			drmModeFreeConnector(connector);
+			return false;
+		}
+
+		keep_common_modes(self, connector);
+	}
+
+	drmModeFreeConnector(connector);
+
+	return true;
+}
+
+/* connectors is a list of ids, otherwise one head on conn */
+static unsigned int
+parse_connectors(struct gst_drm_sink *self, uint32_t *ids)
+{
+	gchar **list;
+	char *end;
+	unsigned int i, j, n = 0;
+
+	if (!self->connectors || !*self->connectors) {
+		ids[0] = self->req_conn_id;
+		return 1;
+	}
+
+	list = g_strsplit(self->connectors, ",", 0);
+
+	for (i = 0; list[i]; i++) {
+		if (n == MAX_HEADS) {
+			fprintf(stderr, "no more than %u connectors\n", MAX_HEADS);
+			n = 0;
+			break;
+		}
+
+		ids[n] = strtoul(list[i], &end, 10);
+		if (end == list[i] || *end || !ids[n]) {
+			fprintf(stderr, "bad connector id: '%s'\n", list[i]);
+			n = 0;
+			break;
+		}
+
+		/* one crtc per connector */
+		for (j = 0; j < n && ids[j] != ids[n]; j++);
+		if (j == n)
+			n++;
+	}
+
+	g_strfreev(list);
+
+	return n;
+}
+
+static bool
+find_output(struct gst_drm_sink *self)
+{
+	drmModeRes *resources;
+	uint32_t ids[MAX_HEADS];
+	uint32_t taken = 0;
+	unsigned int i, n;
+	bool ok = true;
+
+	n = parse_connectors(self, ids);
+	if (!n)
+		return false;
 
-	ret = kms_create(self->fd, &self->drv);
-	if (ret) {
-		perror("failed kms_create()");
+	resources = device_get_resources(self->dev);
+	if (!resources) {
+		fprintf(stderr, "drmModeGetResources failed\n");
 		return false;
 	}
 
+	for (i = 0; i < n && ok; i++)
+		ok = add_head(self, resources, ids[i], i ? 0 : self->req_crtc_id, &taken);
+
+	drmModeFreeResources(resources);
+
+	if (!ok)
+		return false;
+
+	/*
+	 * Spanning heads need their offsets into the framebuffer, a modeset.
+	 * Cloned ones only need to show the mode already.
+	 */
+	self->keep_mode = self->multi_head == MULTI_HEAD_CLONE || self->nr_heads == 1;
+
+	for (i = 0; i < self->nr_heads; i++)
+		self->keep_mode = self->keep_mode && self->heads[i].bound &&
+			self->heads[i].saved_crtc->mode_valid &&
+			same_timings(&self->mode, &self->heads[i].saved_crtc->mode);
+
 	return true;
 }
 
 static gboolean
-stop(GstBaseSink *base)
+start(GstBaseSink *base)
 {
 	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
-	int ret, i;
+	unsigned int i;
+
+	/* open drm device, or share it with other drmsinks */
+
+	self->pool_share = (size_t) self->pool_limit << 20;
+	self->render.pool = pool_open(self->device, self->pool_share);
+	if (!self->render.pool)
+		return false;
 
-    if (self->saved_crtc->mode_valid) {
-        ret = drmModeSetCrtc(self->fd, self->saved_crtc->crtc_id, self->saved_crtc->buffer_id,
-                self->saved_crtc->x, self->saved_crtc->y, &self->conn_id, 1, &self->saved_crtc->mode);
+	self->dev = pool_device(self->render.pool);
 
-        if (ret) {
-            perror("failed drmModeSetCrtc(restore original)");
-        }
-    }
+	if (self->use_import)
+		self->render.prime = pool_prime(self->render.pool);
 
-	for(i = 0; i < DRM_FRAMES; i++) {
-		drmModeRmFB(self->fd, self->fb[i]);
-		kms_bo_unmap(self->bo[i]);
-		kms_bo_destroy(&self->bo[i]);
+	self->render.export = self->use_export && prime_can_export(self->dev);
+
+	/* connector, crtc and mode */
+
+	if (!find_output(self))
+		goto fail;
+
+	/* atomic modesetting, for all heads or none */
+
+	if (self->backend != BACKEND_LEGACY && atomic_enable(self->dev)) {
+		self->use_atomic = true;
+
+		for (i = 0; i < self->nr_heads; i++) {
+			struct head *head = &self->heads[i];
+
+			head->atomic = atomic_new(self->dev->fd, head->crtc_id, head->conn_id, 0);
+			self->use_atomic = self->use_atomic && head->atomic;
+		}
+
+		if (!self->use_atomic)
+			free_atomic(self);
+	}
+
+	if (self->backend == BACKEND_ATOMIC && !self->use_atomic) {
+		fprintf(stderr, "atomic modesetting not available\n");
+		goto fail;
 	}
 
-	kms_destroy(&self->drv);
+	self->render.upload = upload_new(self->upload_threads);
 
-	close(self->fd);
+	GST_OBJECT_LOCK(self);
+	self->render.stats = stats_new();
+	GST_OBJECT_UNLOCK(self);
 
 	return true;
+
+	/* GstBaseSink doesn't stop() what failed to start(); nothing was set yet */
+fail:
+	free_atomic(self);
+
+	for (i = 0; i < self->nr_heads; i++) {
+		drmModeFreeCrtc(self->heads[i].saved_crtc);
+		self->heads[i].saved_crtc = NULL;
+	}
+	self->nr_heads = 0;
+
+	g_free(self->modes);
+	self->modes = NULL;
+	self->nr_modes = 0;
+
+	self->render.prime = NULL;
+
+	pool_unref(self->render.pool, self->pool_share);
+	self->render.pool = NULL;
+	return false;
 }
 
-static GstFlowReturn
-render(GstBaseSink *base, GstBuffer *buffer)
+static gboolean
+stop(GstBaseSink *base)
 {
 	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
-	uint32_t current = self->current;
+	unsigned int i;
 	int ret;
 
-	if (GST_BUFFER_SIZE(buffer) < 4 * self->width * self->height) {
-		fprintf(stderr, "Incoming buffer is less than expected. Some negotiation problem occured...\n");
-		return GST_FLOW_ERROR;
+	if (self->render.present) {
+		present_free(self->render.present);
+		self->render.present = NULL;
+	}
+
+	trace_dump();
+
+	self->enabled = false;
+
+	if (self->render.paced) {
+		gst_base_sink_set_render_delay(base, 0);
+		self->render.render_delay = 0;
+		self->render.paced = false;
 	}
 
-	{
-		uint8_t *dst = (uint8_t *) self->frame[current];
-		uint8_t *src = (uint8_t *) GST_BUFFER_DATA(buffer);
-		uint32_t s;
+	for (i = 0; i < self->nr_heads; i++) {
+		struct head *head = &self->heads[i];
+		drmModeCrtcPtr saved = head->saved_crtc;
+
+		if (saved->mode_valid) {
+			ret = device_set_crtc(self->dev, saved->crtc_id, saved->buffer_id,
+					saved->x, saved->y, &head->conn_id, 1, &saved->mode);
 
-		for (s = 0; s < self->height; s++) {
-			memcpy(dst + s*self->stride[current], src + 4 * s * self->width, 4 * self->width);
+			if (ret) {
+				perror("failed drmModeSetCrtc(restore original)");
+			}
 		}
+
+		drmModeFreeCrtc(saved);
+		head->saved_crtc = NULL;
 	}
 
-    ret = drmModeSetCrtc(self->fd, self->crtc_id, self->fb[current],
-		0, 0, &self->conn_id, 1, self->mode);
+	g_free(self->modes);
+	self->modes = NULL;
+	self->nr_modes = 0;
 
-	if (ret) {
-		perror("failed drmModeSetCrtc(new)");
-		return GST_FLOW_ERROR;
-    }
+	for(i = 0; i < self->render.ring.count; i++) {
+		struct page *page = &self->render.ring.pages[i];
 
-    drmModeDirtyFB(self->fd, self->fb[current], NULL, 0);
+		if (page->buffer)
+			pool_put(self->render.pool, page->buffer);
+		page->buffer = NULL;
+	}
 
-	self->current = current ^ 1;
+	render_release_retired(&self->render, true);
+	render_release_imports(&self->render, true);
 
-	return GST_FLOW_OK;
+	self->render.prime = NULL;
+
+	free_atomic(self);
+	self->nr_heads = 0;
+
+	if (self->render.damage) {
+		damage_free(self->render.damage);
+		self->render.damage = NULL;
+	}
+
+	upload_free(self->render.upload);
+	self->render.upload = NULL;
+
+	GST_OBJECT_LOCK(self);
+	stats_free(self->render.stats);
+	self->render.stats = NULL;
+	GST_OBJECT_UNLOCK(self);
+
+	pool_unref(self->render.pool, self->pool_share);
+	self->render.pool = NULL;
+
+	return true;
+}
+
+/* periodic element message with the stats of the last interval */
+static void
+post_stats(struct gst_drm_sink *self)
+{
+	GstStructure *structure;
+
+	if (!self->stats_interval || !stats_window_elapsed(self->render.stats, self->stats_interval))
+		return;
+
+	structure = stats_structure(self->render.stats, "drmsink-stats", true);
+	gst_element_post_message(GST_ELEMENT(self), gst_message_new_element(GST_OBJECT(self), structure));
+}
+
+static GstFlowReturn
+render(GstBaseSink *base, GstBuffer *buffer)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
+
+	post_stats(self);
+
+	return render_frame(&self->render, buffer, self->render.paced ? pacing_target(base, buffer) : 0);
+}
+
+/* the clock isn't running yet, nothing to pace against */
+static GstFlowReturn
+preroll(GstBaseSink *base, GstBuffer *buffer)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
+
+	post_stats(self);
+
+	return render_frame(&self->render, buffer, 0);
+}
+
+static gboolean
+unlock(GstBaseSink *base)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
+
+	if (self->render.present)
+		present_set_flushing(self->render.present, true);
+
+	return true;
+}
+
+static gboolean
+unlock_stop(GstBaseSink *base)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)base;
+
+	if (self->render.present)
+		present_set_flushing(self->render.present, false);
+
+	return true;
 }
 
 static void
@@ -402,26 +1301,117 @@ class_init(void *g_class, void *class_data)
 	gobject_class->set_property = set_property;
 
 	g_object_class_install_property (gobject_class, PROP_CONN,
-			g_param_spec_int ("conn", "connector_id", "DRM connector id",
+			g_param_spec_int ("conn", "connector_id", "DRM connector id (0 = first connected)",
 				0, 1024, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
 	g_object_class_install_property (gobject_class, PROP_CRTC,
-			g_param_spec_int ("crtc", "crtc_id", "DRM crtc id",
+			g_param_spec_int ("crtc", "crtc_id", "DRM crtc id (0 = one the connector can use)",
 				0, 1024, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
 	g_object_class_install_property (gobject_class, PROP_MODE,
-			g_param_spec_string ("mode", "mode", "DRM connector mode",
+			g_param_spec_string ("mode", "mode", "DRM connector mode name, preferred, or current to keep the mode on screen",
 				DEFAULT_PROP_MODE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
 	g_object_class_install_property (gobject_class, PROP_FILE,
-			g_param_spec_string ("device", "device", "DRM device",
+			g_param_spec_string ("device", "device", "DRM device, or memory[:WxH[@HZ]][,dump=FILE] for one in memory",
 				DEFAULT_PROP_FILE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+	g_object_class_install_property (gobject_class, PROP_POSX,
+			g_param_spec_int ("posx", "posx", "video left top corner X position (-1 = centered)",
+				-1, 4096, DEFAULT_PROP_POS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_POSY,
+			g_param_spec_int ("posy", "posy", "video left top corner Y position (-1 = centered)",
+				-1, 4096, DEFAULT_PROP_POS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_BUFFERS,
+			g_param_spec_int ("buffers", "buffers", "Number of scanout buffers",
+				RING_MIN_PAGES, RING_MAX_PAGES, DEFAULT_PROP_BUFFERS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_UPLOAD_THREADS,
+			g_param_spec_int ("upload-threads", "upload-threads", "Number of threads copying each frame",
+				1, UPLOAD_MAX_THREADS, DEFAULT_PROP_UPLOAD_THREADS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_DAMAGE,
+			g_param_spec_boolean ("damage", "damage", "Upload only changed rows and skip unchanged frames",
+				DEFAULT_PROP_DAMAGE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_BACKEND,
+			g_param_spec_enum ("backend", "backend", "Modesetting interface",
+				GST_DRM_BACKEND_TYPE, DEFAULT_PROP_BACKEND, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_POOL_LIMIT,
+			g_param_spec_int ("pool-limit", "pool-limit", "MiB of idle scanout buffers kept for reuse, added to what other sinks of this kind on the device ask for",
+				0, 4096, DEFAULT_PROP_POOL_LIMIT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_IMPORT,
+			g_param_spec_boolean ("import", "import", "Scan out upstream dma-buf buffers without copying",
+				DEFAULT_PROP_IMPORT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_EXPORT,
+			g_param_spec_boolean ("export", "export", "Attach a dma-buf of the scanout buffer to buffers given upstream",
+				DEFAULT_PROP_EXPORT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_STATS,
+			g_param_spec_boxed ("stats", "stats", "Frame counters, copy rate, fps and latency percentiles",
+				GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+			g_param_spec_int ("stats-interval", "stats-interval", "Milliseconds between stats element messages (0 = none)",
+				0, 60000, DEFAULT_PROP_STATS_INTERVAL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_PACING,
+			g_param_spec_boolean ("pacing", "pacing", "Show each frame on the vblank closest to its clock time",
+				DEFAULT_PROP_PACING, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_MATCH_REFRESH,
+			g_param_spec_boolean ("match-refresh", "match-refresh", "Switch to the mode of the same size whose refresh suits the framerate best",
+				DEFAULT_PROP_MATCH_REFRESH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_CONNECTORS,
+			g_param_spec_string ("connectors", "connectors", "Comma separated DRM connector ids of the heads showing the video, instead of conn",
+				DEFAULT_PROP_CONNECTORS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	g_object_class_install_property (gobject_class, PROP_MULTI_HEAD,
+			g_param_spec_enum ("multi-head", "multi-head", "What several connectors show, all from one framebuffer",
+				GST_DRM_MULTI_HEAD_TYPE, DEFAULT_PROP_MULTI_HEAD, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	base_sink_class->get_caps = get_caps;
 	base_sink_class->set_caps = setcaps;
 	base_sink_class->start = start;
 	base_sink_class->stop = stop;
 	base_sink_class->render = render;
-	base_sink_class->preroll = render;
+	base_sink_class->preroll = preroll;
+	base_sink_class->buffer_alloc = buffer_alloc;
+	base_sink_class->unlock = unlock;
+	base_sink_class->unlock_stop = unlock_stop;
+}
+
+static void
+instance_init(GTypeInstance *instance, void *g_class)
+{
+	struct gst_drm_sink *self = (struct gst_drm_sink *)instance;
+
+	self->render.sink = &self->parent;
+	/* dirty_fb wants to know where the video changed */
+	self->render.use_clips = true;
+
+	self->mode_name = g_strdup(DEFAULT_PROP_MODE);
+	self->device = g_strdup(DEFAULT_PROP_FILE);
+	self->nr_buffers = DEFAULT_PROP_BUFFERS;
+	self->posx = DEFAULT_PROP_POS;
+	self->posy = DEFAULT_PROP_POS;
+	self->upload_threads = DEFAULT_PROP_UPLOAD_THREADS;
+	self->use_damage = DEFAULT_PROP_DAMAGE;
+	self->backend = DEFAULT_PROP_BACKEND;
+	self->pool_limit = DEFAULT_PROP_POOL_LIMIT;
+	self->use_import = DEFAULT_PROP_IMPORT;
+	self->use_export = DEFAULT_PROP_EXPORT;
+	self->stats_interval = DEFAULT_PROP_STATS_INTERVAL;
+	self->pacing = DEFAULT_PROP_PACING;
+	self->match_refresh = DEFAULT_PROP_MATCH_REFRESH;
+	self->connectors = g_strdup(DEFAULT_PROP_CONNECTORS);
+	self->multi_head = DEFAULT_PROP_MULTI_HEAD;
 }
 
 static void
@@ -456,6 +1446,7 @@ gst_drm_sink_get_type(void)
 			.class_init = class_init,
 			.base_init = base_init,
 			.instance_size = sizeof(struct gst_drm_sink),
+			.instance_init = instance_init,
 		};
 
 		type = g_type_register_static(GST_TYPE_BASE_SINK, "GstDrmSink", &type_info, 0);
@@ -471,6 +1462,11 @@ plugin_init(GstPlugin *plugin)
 	drm_debug = _gst_debug_category_new("drmsink", 0, "drmsink");
 #endif
 
+	log_init();
+
+	convert_init();
+	copy_init();
+
 	if (!gst_element_register(plugin, "drmsink", GST_RANK_SECONDARY, GST_DRM_SINK_TYPE))
 		return false;
 
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "format.h"
+
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#define ROUND_UP(num, scale) (((num) + ((scale) - 1)) & ~((scale) - 1))
+
+const struct format formats[] = {
+	{ 0, DRM_FORMAT_XRGB8888, 1 },
+	{ GST_MAKE_FOURCC('I', '4', '2', '0'), DRM_FORMAT_YUV420, 3 },
+	{ GST_MAKE_FOURCC('N', 'V', '1', '2'), DRM_FORMAT_NV12, 2 },
+	{ GST_MAKE_FOURCC('Y', 'U', 'Y', '2'), DRM_FORMAT_YUYV, 1 },
+	{ GST_MAKE_FOURCC('U', 'Y', 'V', 'Y'), DRM_FORMAT_UYVY, 1 },
+};
+
+const unsigned int nr_formats = G_N_ELEMENTS(formats);
+
+const struct format *
+format_by_drm(uint32_t drm_format)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_formats; i++)
+		if (formats[i].drm_format == drm_format)
+			return &formats[i];
+
+	return NULL;
+}
+
+const struct format *
+format_from_structure(const GstStructure *structure)
+{
+	guint32 fourcc;
+	unsigned int i;
+
+	if (gst_structure_has_name(structure, "video/x-raw-rgb"))
+		return &formats[0];
+
+	if (!gst_structure_get_fourcc(structure, "format", &fourcc))
+		return NULL;
+
+	for (i = 1; i < nr_formats; i++)
+		if (formats[i].fourcc == fourcc)
+			return &formats[i];
+
+	return NULL;
+}
+
+/* max_framerate in whole fps, the refresh rate of the output */
+GstStructure *
+format_to_structure(const struct format *format, int max_framerate)
+{
+	if (!format->fourcc)
+		return gst_structure_new("video/x-raw-rgb",
+				"width", GST_TYPE_INT_RANGE, 16, 4096,
+				"height", GST_TYPE_INT_RANGE, 16, 4096,
+				"bpp", G_TYPE_INT, 32,
+				"depth", G_TYPE_INT, 24,
+				"endianness", G_TYPE_INT, 4321,
+				"green_mask", G_TYPE_INT, 16711680,
+				"red_mask", G_TYPE_INT, 65280,
+				"blue_mask", G_TYPE_INT, -16777216,
+				"framerate", GST_TYPE_FRACTION_RANGE, 0, 1, max_framerate, 1,
+				NULL);
+
+	return gst_structure_new("video/x-raw-yuv",
+			"format", GST_TYPE_FOURCC, format->fourcc,
+			"width", GST_TYPE_INT_RANGE, 16, 4096,
+			"height", GST_TYPE_INT_RANGE, 16, 4096,
+			"framerate", GST_TYPE_FRACTION_RANGE, 0, 1, max_framerate, 1,
+			NULL);
+}
+
+static void
+set_plane(struct layout *layout, unsigned int i,
+		uint32_t offset, uint32_t pitch, uint32_t row_bytes, uint32_t rows)
+{
+	layout->offset[i] = offset;
+	layout->pitch[i] = pitch;
+	layout->row_bytes[i] = row_bytes;
+	layout->rows[i] = rows;
+	layout->size = offset + pitch * rows;
+}
+
+/* the strides and offsets GStreamer uses for tightly allocated frames */
+void
+format_gst_layout(const struct format *format,
+		uint32_t width, uint32_t height, struct layout *layout)
+{
+	uint32_t stride, cstride, cheight = ROUND_UP(height, 2) / 2;
+
+	memset(layout, 0, sizeof(*layout));
+	layout->planes = format->planes;
+
+	switch (format->drm_format) {
+	case DRM_FORMAT_YUV420:
+		stride = ROUND_UP(width, 4);
+		cstride = ROUND_UP(ROUND_UP(width, 2) / 2, 4);
+		set_plane(layout, 0, 0, stride, width, height);
+		set_plane(layout, 1, stride * ROUND_UP(height, 2), cstride, (width + 1) / 2, cheight);
+		set_plane(layout, 2, layout->size, cstride, (width + 1) / 2, cheight);
+		break;
+	case DRM_FORMAT_NV12:
+		stride = ROUND_UP(width, 4);
+		set_plane(layout, 0, 0, stride, width, height);
+		set_plane(layout, 1, stride * ROUND_UP(height, 2), stride, ROUND_UP(width, 2), cheight);
+		break;
+	case DRM_FORMAT_YUYV:
+	case DRM_FORMAT_UYVY:
+		stride = ROUND_UP(width * 2, 4);
+		set_plane(layout, 0, 0, stride, ROUND_UP(width, 2) * 2, height);
+		break;
+	default:
+		set_plane(layout, 0, 0, width * 4, width * 4, height);
+		break;
+	}
+}
+
+/*
+ * libkms only creates 32bpp scanout buffers, so other formats get one
+ * sized to hold all their planes at the first plane's pitch.
+ */
+void
+format_bo_size(const struct format *format,
+		uint32_t width, uint32_t height, uint32_t *bo_width, uint32_t *bo_height)
+{
+	switch (format->drm_format) {
+	case DRM_FORMAT_YUV420:
+	case DRM_FORMAT_NV12:
+		*bo_width = ROUND_UP(width, 8) / 4;
+		*bo_height = ROUND_UP(height, 2) * 3 / 2;
+		break;
+	case DRM_FORMAT_YUYV:
+	case DRM_FORMAT_UYVY:
+		*bo_width = ROUND_UP(width, 2) / 2;
+		*bo_height = height;
+		break;
+	default:
+		*bo_width = width;
+		*bo_height = height;
+		break;
+	}
+}
+
+void
+format_bo_layout(const struct format *format,
+		uint32_t width, uint32_t height, uint32_t pitch, struct layout *layout)
+{
+	uint32_t cheight = ROUND_UP(height, 2) / 2;
+
+	memset(layout, 0, sizeof(*layout));
+	layout->planes = format->planes;
+
+	switch (format->drm_format) {
+	case DRM_FORMAT_YUV420:
+		set_plane(layout, 0, 0, pitch, width, height);
+		set_plane(layout, 1, pitch * ROUND_UP(height, 2), pitch / 2, (width + 1) / 2, cheight);
+		set_plane(layout, 2, layout->size, pitch / 2, (width + 1) / 2, cheight);
+		break;
+	case DRM_FORMAT_NV12:
+		set_plane(layout, 0, 0, pitch, width, height);
+		set_plane(layout, 1, pitch * ROUND_UP(height, 2), pitch, ROUND_UP(width, 2), cheight);
+		break;
+	case DRM_FORMAT_YUYV:
+	case DRM_FORMAT_UYVY:
+		set_plane(layout, 0, 0, pitch, ROUND_UP(width, 2) * 2, height);
+		break;
+	default:
+		set_plane(layout, 0, 0, pitch, width * 4, height);
+		break;
+	}
+}
+
+bool
+format_layout_equal(const struct layout *a, const struct layout *b)
+{
+	unsigned int i;
+
+	if (a->planes != b->planes)
+		return false;
+
+	for (i = 0; i < a->planes; i++)
+		if (a->offset[i] != b->offset[i] || a->pitch[i] != b->pitch[i])
+			return false;
+
+	return true;
+}
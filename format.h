@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <gst/gst.h>
+
+#define FORMAT_MAX_PLANES	3
+/* before a mode is known */
+#define FORMAT_MAX_FRAMERATE	240
+
+struct format {
+	uint32_t fourcc;	/* GStreamer fourcc, 0 for 32bpp xRGB */
+	uint32_t drm_format;
+	unsigned int planes;
+};
+
+/* where each plane of a frame lives inside a buffer */
+struct layout {
+	unsigned int planes;
+	uint32_t offset[FORMAT_MAX_PLANES];
+	uint32_t pitch[FORMAT_MAX_PLANES];
+	uint32_t row_bytes[FORMAT_MAX_PLANES];
+	uint32_t rows[FORMAT_MAX_PLANES];
+	uint32_t size;
+};
+
+extern const struct format formats[];
+extern const unsigned int nr_formats;
+
+const struct format *format_by_drm(uint32_t drm_format);
+const struct format *format_from_structure(const GstStructure *structure);
+GstStructure *format_to_structure(const struct format *format, int max_framerate);
+
+void format_gst_layout(const struct format *format,
+		uint32_t width, uint32_t height, struct layout *layout);
+void format_bo_size(const struct format *format,
+		uint32_t width, uint32_t height, uint32_t *bo_width, uint32_t *bo_height);
+void format_bo_layout(const struct format *format,
+		uint32_t width, uint32_t height, uint32_t pitch, struct layout *layout);
+bool format_layout_equal(const struct layout *a, const struct layout *b);
+
+#endif /* FORMAT_H */
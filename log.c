@@ -13,25 +13,15 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <gst/gst.h>
 
-#ifndef GST_DISABLE_GST_DEBUG
-extern GstDebugCategory *drm_debug;
-#endif
+#define TRACE_RECORDS	4096	/* per thread, a power of two */
+#define TRACE_MAX_THREADS	64
 
 #ifndef GST_DISABLE_GST_DEBUG
-static inline GstDebugLevel
-log_level_to_gst(unsigned int level)
-{
-	switch (level) {
-	case 0: return GST_LEVEL_ERROR;
-	case 1: return GST_LEVEL_WARNING;
-	case 2:
-	case 3: return GST_LEVEL_INFO;
-	default: return GST_LEVEL_DEBUG;
-	}
-}
+extern GstDebugCategory *drm_debug;
 #endif
 
 void pr_helper(unsigned int level,
@@ -42,33 +32,226 @@ void pr_helper(unsigned int level,
 		const char *fmt,
 		...)
 {
-	char *tmp;
-	va_list args;
+	char tmp[256];
+	va_list args, copy;
 
 	va_start(args, fmt);
 
-	if (vasprintf(&tmp, fmt, args) < 0)
-		goto leave;
+	if (level <= LOG_PRINT_LEVEL) {
+		/* gst_debug_log_valist() needs the arguments again */
+		va_copy(copy, args);
+		vsnprintf(tmp, sizeof(tmp), fmt, copy);
+		va_end(copy);
 
-	if (level <= 1)
-		g_printerr("%s: %s\n", function, tmp);
-	else if (level == 2)
-		g_print("%s:%s(%u): %s\n", file, function, line, tmp);
-#if defined(DEVEL) || defined(DEBUG)
-	else if (level == 3)
-		g_print("%s: %s\n", function, tmp);
-#endif
-#ifdef DEBUG
-	else if (level == 4)
-		g_print("%s:%s(%u): %s\n", file, function, line, tmp);
-#endif
+		if (level <= 1)
+			g_printerr("%s: %s\n", function, tmp);
+		else if (level == 2)
+			g_print("%s:%s(%u): %s\n", file, function, line, tmp);
+		else if (level == 3)
+			g_print("%s: %s\n", function, tmp);
+		else
+			g_print("%s:%s(%u): %s\n", file, function, line, tmp);
+	}
 
 #ifndef GST_DISABLE_GST_DEBUG
-	gst_debug_log_valist(drm_debug, log_level_to_gst(level), file, function, line, object, fmt, args);
+	if (drm_debug && LOG_GST_LEVEL(level) <= gst_debug_category_get_threshold(drm_debug))
+		gst_debug_log_valist(drm_debug, LOG_GST_LEVEL(level), file, function, line, object, fmt, args);
 #endif
 
-	free(tmp);
-
-leave:
 	va_end(args);
 }
+
+/* tracing */
+
+struct trace_entry {
+	gint64 time;
+	const void *object;
+	uint32_t event;
+	uint32_t arg;
+};
+
+/* written only by its thread, read by trace_dump() */
+struct trace_ring {
+	volatile gint head;	/* records ever written */
+	guint dumped;
+	volatile gint owned;	/* a live thread writes here */
+	unsigned int thread;
+	struct trace_entry entries[TRACE_RECORDS];
+};
+
+int trace_enabled;
+
+static const char *trace_file;
+static GPrivate *current;
+/* in current of a thread that found every ring taken: it traces nothing */
+static struct trace_ring no_ring;
+
+G_LOCK_DEFINE_STATIC(rings);
+static struct trace_ring *rings[TRACE_MAX_THREADS];
+
+static const char *const event_names[TRACE_NR_EVENTS] = {
+	[TRACE_FRAME] = "frame",
+	[TRACE_COPY] = "copy",
+	[TRACE_IMPORT] = "import",
+	[TRACE_SKIP] = "skip",
+	[TRACE_DROP] = "drop",
+	[TRACE_QUEUE] = "queue",
+	[TRACE_FLIP] = "flip",
+	[TRACE_FLIP_DONE] = "flip-done",
+};
+
+/* the thread is gone, the next new one takes over its ring */
+static void
+release_ring(gpointer data)
+{
+	struct trace_ring *ring = data;
+
+	if (ring != &no_ring)
+		g_atomic_int_set(&ring->owned, 0);
+}
+
+/* once per thread, the only allocation; no_ring when all are owned */
+static struct trace_ring *
+claim_ring(void)
+{
+	struct trace_ring *ring = NULL;
+	unsigned int i;
+
+	G_LOCK(rings);
+
+	for (i = 0; i < TRACE_MAX_THREADS; i++) {
+		if (!rings[i]) {
+			rings[i] = g_new0(struct trace_ring, 1);
+			rings[i]->thread = i;
+		}
+
+		if (!g_atomic_int_get(&rings[i]->owned)) {
+			ring = rings[i];
+			ring->owned = 1;
+			break;
+		}
+	}
+
+	G_UNLOCK(rings);
+
+	/* also remembered when there is none, no more lookups */
+	if (!ring)
+		ring = &no_ring;
+
+	g_private_set(current, ring);
+
+	return ring;
+}
+
+void
+trace_record(enum trace_event event, const void *object, uint32_t arg)
+{
+	struct trace_ring *ring;
+	struct trace_entry *e;
+	gint head;
+
+	ring = g_private_get(current);
+	if (G_UNLIKELY(!ring))
+		ring = claim_ring();
+	if (G_UNLIKELY(ring == &no_ring))
+		return;
+
+	head = ring->head;
+	e = &ring->entries[head & (TRACE_RECORDS - 1)];
+	e->time = g_get_monotonic_time();
+	e->object = object;
+	e->event = event;
+	e->arg = arg;
+
+	/* publishes the entry */
+	g_atomic_int_set(&ring->head, head + 1);
+}
+
+struct dump_entry {
+	struct trace_entry entry;
+	unsigned int thread;
+};
+
+static int
+cmp_entry(const void *a, const void *b)
+{
+	const struct dump_entry *x = a, *y = b;
+
+	return x->entry.time < y->entry.time ? -1 : x->entry.time > y->entry.time;
+}
+
+/* what was recorded since the last dump, oldest first, all threads merged */
+void
+trace_dump(void)
+{
+	struct dump_entry *out;
+	unsigned int i, n = 0;
+	FILE *file;
+
+	if (!trace_enabled)
+		return;
+
+	G_LOCK(rings);
+
+	for (i = 0; i < TRACE_MAX_THREADS && rings[i]; i++);
+	out = g_new(struct dump_entry, TRACE_RECORDS * i);
+
+	for (i = 0; i < TRACE_MAX_THREADS && rings[i]; i++) {
+		struct trace_ring *ring = rings[i];
+		guint head, first, end, lost, j, start = n;
+
+		head = g_atomic_int_get(&ring->head);
+		first = head - ring->dumped > TRACE_RECORDS ? head - TRACE_RECORDS : ring->dumped;
+
+		for (j = first; j != head; j++) {
+			out[n].entry = ring->entries[j & (TRACE_RECORDS - 1)];
+			out[n++].thread = ring->thread;
+		}
+
+		/* whatever the writer lapped while we copied, or is writing, is garbage */
+		end = g_atomic_int_get(&ring->head) + 1;
+		if (end - first > TRACE_RECORDS) {
+			lost = MIN(end - first - TRACE_RECORDS, n - start);
+			memmove(&out[start], &out[start + lost], (n - start - lost) * sizeof(*out));
+			n -= lost;
+		}
+
+		ring->dumped = head;
+	}
+
+	G_UNLOCK(rings);
+
+	file = fopen(trace_file, "a");
+	if (!file) {
+		perror("cannot open trace file");
+		g_free(out);
+		return;
+	}
+
+	qsort(out, n, sizeof(*out), cmp_entry);
+
+	for (i = 0; i < n; i++) {
+		struct trace_entry *e = &out[i].entry;
+
+		fprintf(file, "%" G_GINT64_FORMAT " %u %p %s %u\n", e->time, out[i].thread,
+				e->object, event_names[e->event], e->arg);
+	}
+
+	fclose(file);
+	g_free(out);
+}
+
+/* from plugin_init(), before any element exists */
+void
+log_init(void)
+{
+	G_LOCK(rings);
+
+	if (!current) {
+		trace_file = g_getenv("DRMSINK_TRACE");
+		current = g_private_new(release_ring);
+		trace_enabled = trace_file && *trace_file;
+	}
+
+	G_UNLOCK(rings);
+}
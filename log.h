@@ -11,6 +11,12 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include <stdint.h>
+
+#ifndef GST_DISABLE_GST_DEBUG
+#include <gst/gst.h>
+#endif
+
 /* #define DEBUG */
 
 void pr_helper(unsigned int level,
@@ -21,18 +27,68 @@ void pr_helper(unsigned int level,
 		const char *fmt,
 		...) __attribute__((format(printf, 6, 7)));
 
-#define pr_base(level, object, ...) pr_helper(level, object, __FILE__, __func__, __LINE__, __VA_ARGS__)
+/* highest level printed to the console */
+#if defined(DEBUG)
+#define LOG_PRINT_LEVEL 4
+#elif defined(DEVEL)
+#define LOG_PRINT_LEVEL 3
+#else
+#define LOG_PRINT_LEVEL 2
+#endif
+
+#ifndef GST_DISABLE_GST_DEBUG
+#define LOG_GST_LEVEL(level) \
+	((level) == 0 ? GST_LEVEL_ERROR : \
+	 (level) == 1 ? GST_LEVEL_WARNING : \
+	 (level) <= 3 ? GST_LEVEL_INFO : GST_LEVEL_DEBUG)
+/* the same global minimum GST_CAT_LEVEL_LOG() checks first */
+#define log_gst_enabled(level) __builtin_expect(LOG_GST_LEVEL(level) <= __gst_debug_min, 0)
+#else
+#define log_gst_enabled(level) 0
+#endif
+
+/* the level is a constant, a filtered out message costs one branch */
+#define pr_base(level, object, ...) \
+	do { \
+		if ((level) <= LOG_PRINT_LEVEL || log_gst_enabled(level)) \
+			pr_helper(level, object, __FILE__, __func__, __LINE__, __VA_ARGS__); \
+	} while (0)
 
 #define pr_err(object, ...) pr_base(0, object, __VA_ARGS__)
 #define pr_warning(object, ...) pr_base(1, object, __VA_ARGS__)
 #define pr_test(object, ...) pr_base(2, object, __VA_ARGS__)
-
-#if !defined(GST_DISABLE_GST_DEBUG) || defined(DEBUG)
 #define pr_info(object, ...) pr_base(3, object, __VA_ARGS__)
 #define pr_debug(object, ...) pr_base(4, object, __VA_ARGS__)
-#else
-#define pr_info(object, ...) ({ if (0) pr_base(3, object, __VA_ARGS__); })
-#define pr_debug(object, ...) ({ if (0) pr_base(4, object, __VA_ARGS__); })
-#endif
+
+/*
+ * Hot path tracing: binary records in a per-thread ring, formatted only
+ * by trace_dump(). Enabled by setting DRMSINK_TRACE to the file the
+ * dumps are appended to; otherwise trace() is a single branch.
+ */
+
+enum trace_event {
+	TRACE_FRAME,		/* render() entered */
+	TRACE_COPY,		/* frame uploaded, arg: usec */
+	TRACE_IMPORT,		/* zero copy, arg: fb */
+	TRACE_SKIP,		/* unchanged frame */
+	TRACE_DROP,		/* no page for the frame */
+	TRACE_QUEUE,		/* handed to the presentation thread, arg: fb */
+	TRACE_FLIP,		/* flip submitted, arg: fb */
+	TRACE_FLIP_DONE,	/* flip completed, arg: vblank sequence */
+	TRACE_NR_EVENTS,
+};
+
+extern int trace_enabled;
+
+void trace_record(enum trace_event event, const void *object, uint32_t arg);
+
+#define trace(event, object, arg) \
+	do { \
+		if (__builtin_expect(trace_enabled, 0)) \
+			trace_record(event, object, arg); \
+	} while (0)
+
+void log_init(void);
+void trace_dump(void);
 
 #endif /* LOG_H */
@@ -0,0 +1,774 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "memdev.h"
+#include "format.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#define ROUND_UP(num, scale) (((num) + ((scale) - 1)) & ~((scale) - 1))
+
+#define MAX_MODES	3
+
+struct bo {
+	uint32_t handle;
+	uint32_t pitch;
+	size_t size;
+	uint8_t *data;
+};
+
+struct fb {
+	uint32_t id;
+	uint32_t width;
+	uint32_t height;
+	const struct format *format;
+	struct bo *bos[4];
+	uint32_t pitches[4];
+	uint32_t offsets[4];
+};
+
+struct memdev {
+	GMutex *lock;
+	GHashTable *bos;
+	GHashTable *fbs;
+	uint32_t next_id;
+
+	drmModeModeInfo modes[MAX_MODES];
+	unsigned int nr_modes;
+
+	/* crtc */
+	bool active;
+	drmModeModeInfo mode;
+	uint32_t fb;
+	uint32_t x, y;
+	gint64 epoch;		/* vblank 0, at the modeset */
+	gint64 period;		/* usec */
+
+	bool flip_pending;
+	uint32_t flip_fb;
+	bool flip_event;
+	void *flip_data;
+	gint64 flip_due;
+
+	/* overlay plane */
+	uint32_t plane_crtc;
+	uint32_t plane_fb;
+	int32_t plane_x, plane_y;
+
+	FILE *dump;
+};
+
+/* made up blanking, only the refresh rate matters */
+static void
+make_mode(drmModeModeInfo *mode, uint32_t width, uint32_t height,
+		uint32_t refresh, bool preferred)
+{
+	memset(mode, 0, sizeof(*mode));
+
+	mode->hdisplay = width;
+	mode->hsync_start = width + 48;
+	mode->hsync_end = width + 80;
+	mode->htotal = width + 160;
+	mode->vdisplay = height;
+	mode->vsync_start = height + 3;
+	mode->vsync_end = height + 8;
+	mode->vtotal = height + 30;
+	mode->clock = (uint64_t) mode->htotal * mode->vtotal * refresh / 1000;
+	mode->vrefresh = refresh;
+	mode->type = DRM_MODE_TYPE_DRIVER | (preferred ? DRM_MODE_TYPE_PREFERRED : 0);
+	snprintf(mode->name, sizeof(mode->name), "%ux%u", width, height);
+}
+
+static gint64
+mode_period(const drmModeModeInfo *mode)
+{
+	if (!mode->clock)
+		return G_USEC_PER_SEC / 60;
+
+	return (gint64) mode->htotal * mode->vtotal * 1000 / mode->clock;
+}
+
+static gint64
+next_vblank(struct memdev *m, gint64 now)
+{
+	return m->epoch + ((now - m->epoch) / m->period + 1) * m->period;
+}
+
+static void
+arm(struct device *dev, gint64 due)
+{
+	struct itimerspec its = {
+		.it_value = {
+			.tv_sec = due / G_USEC_PER_SEC,
+			.tv_nsec = (due % G_USEC_PER_SEC) * 1000,
+		},
+	};
+
+	/* g_get_monotonic_time() is CLOCK_MONOTONIC too */
+	if (timerfd_settime(dev->fd, TFD_TIMER_ABSTIME, &its, NULL))
+		perror("failed timerfd_settime()");
+}
+
+/* called with the lock held */
+static void
+dump_fb(struct memdev *m, uint32_t id)
+{
+	struct fb *fb;
+	struct layout layout;
+	unsigned int i;
+	uint32_t y;
+
+	if (!m->dump || !id)
+		return;
+
+	fb = g_hash_table_lookup(m->fbs, GUINT_TO_POINTER(id));
+	if (!fb)
+		return;
+
+	format_bo_layout(fb->format, fb->width, fb->height, fb->pitches[0], &layout);
+
+	for (i = 0; i < layout.planes; i++) {
+		const uint8_t *p = fb->bos[i]->data + fb->offsets[i];
+
+		for (y = 0; y < layout.rows[i]; y++, p += fb->pitches[i])
+			fwrite(p, layout.row_bytes[i], 1, m->dump);
+	}
+
+	fflush(m->dump);
+}
+
+static void
+free_bo(gpointer data)
+{
+	struct bo *bo = data;
+
+	g_free(bo->data);
+	g_free(bo);
+}
+
+static int
+memdev_open(struct device *dev, const char *path)
+{
+	struct memdev *m;
+	const char *args = path + strlen(MEMDEV_PREFIX), *dump;
+	unsigned int width = 1920, height = 1080, refresh = 60;
+
+	if (*args == ':' && sscanf(args + 1, "%ux%u@%u", &width, &height, &refresh) < 2) {
+		fprintf(stderr, "bad memory device: %s\n", path);
+		return -1;
+	}
+
+	if (!width || !height || !refresh) {
+		fprintf(stderr, "bad memory device mode: %s\n", path);
+		return -1;
+	}
+
+	dev->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (dev->fd < 0) {
+		perror("failed timerfd_create()");
+		return -1;
+	}
+
+	m = g_new0(struct memdev, 1);
+
+	dump = strstr(args, ",dump=");
+	if (dump) {
+		m->dump = fopen(dump + strlen(",dump="), "wb");
+		if (!m->dump) {
+			perror("cannot open dump file");
+			close(dev->fd);
+			g_free(m);
+			return -1;
+		}
+	}
+
+	make_mode(&m->modes[m->nr_modes++], width, height, refresh, true);
+	if (width > 1280 && height > 720)
+		make_mode(&m->modes[m->nr_modes++], 1280, 720, 60, false);
+	if (width > 640 && height > 480)
+		make_mode(&m->modes[m->nr_modes++], 640, 480, 60, false);
+
+	m->lock = g_mutex_new();
+	m->bos = g_hash_table_new_full(NULL, NULL, NULL, free_bo);
+	m->fbs = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+	m->period = mode_period(&m->modes[0]);
+
+	dev->priv = m;
+
+	return 0;
+}
+
+static void
+memdev_close(struct device *dev)
+{
+	struct memdev *m = dev->priv;
+
+	if (m->dump)
+		fclose(m->dump);
+
+	g_hash_table_destroy(m->fbs);
+	g_hash_table_destroy(m->bos);
+	g_mutex_free(m->lock);
+	g_free(m);
+
+	close(dev->fd);
+}
+
+static int
+memdev_get_cap(struct device *dev, uint64_t cap, uint64_t *value)
+{
+	switch (cap) {
+	case DRM_CAP_DUMB_BUFFER:
+	case DRM_CAP_TIMESTAMP_MONOTONIC:
+		*value = 1;
+		return 0;
+	case DRM_CAP_PRIME:
+		*value = 0;
+		return 0;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+}
+
+static int
+memdev_set_client_cap(struct device *dev, uint64_t cap, uint64_t value)
+{
+	errno = EINVAL;
+	return -EINVAL;
+}
+
+/* everything we return is freed by drmModeFree*(), so malloc() it */
+
+static drmModeRes *
+memdev_get_resources(struct device *dev)
+{
+	drmModeRes *res;
+
+	res = calloc(1, sizeof(*res));
+	res->count_crtcs = 1;
+	res->crtcs = malloc(sizeof(uint32_t));
+	res->crtcs[0] = MEMDEV_CRTC_ID;
+	res->count_encoders = 1;
+	res->encoders = malloc(sizeof(uint32_t));
+	res->encoders[0] = MEMDEV_ENCODER_ID;
+	res->count_connectors = 1;
+	res->connectors = malloc(sizeof(uint32_t));
+	res->connectors[0] = MEMDEV_CONN_ID;
+	res->max_width = 8192;
+	res->max_height = 8192;
+
+	return res;
+}
+
+static drmModeConnector *
+memdev_get_connector(struct device *dev, uint32_t id)
+{
+	struct memdev *m = dev->priv;
+	drmModeConnector *conn;
+
+	if (id != MEMDEV_CONN_ID) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	conn = calloc(1, sizeof(*conn));
+	conn->connector_id = id;
+	conn->connection = DRM_MODE_CONNECTED;
+	conn->count_modes = m->nr_modes;
+	conn->modes = malloc(m->nr_modes * sizeof(*conn->modes));
+	memcpy(conn->modes, m->modes, m->nr_modes * sizeof(*conn->modes));
+	conn->count_encoders = 1;
+	conn->encoders = malloc(sizeof(uint32_t));
+	conn->encoders[0] = MEMDEV_ENCODER_ID;
+
+	g_mutex_lock(m->lock);
+	conn->encoder_id = m->active ? MEMDEV_ENCODER_ID : 0;
+	g_mutex_unlock(m->lock);
+
+	return conn;
+}
+
+static drmModeEncoder *
+memdev_get_encoder(struct device *dev, uint32_t id)
+{
+	struct memdev *m = dev->priv;
+	drmModeEncoder *encoder;
+
+	if (id != MEMDEV_ENCODER_ID) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	encoder = calloc(1, sizeof(*encoder));
+	encoder->encoder_id = id;
+	encoder->possible_crtcs = 1;
+
+	g_mutex_lock(m->lock);
+	encoder->crtc_id = m->active ? MEMDEV_CRTC_ID : 0;
+	g_mutex_unlock(m->lock);
+
+	return encoder;
+}
+
+static drmModeCrtc *
+memdev_get_crtc(struct device *dev, uint32_t id)
+{
+	struct memdev *m = dev->priv;
+	drmModeCrtc *crtc;
+
+	if (id != MEMDEV_CRTC_ID) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	crtc = calloc(1, sizeof(*crtc));
+	crtc->crtc_id = id;
+
+	g_mutex_lock(m->lock);
+	if (m->active) {
+		crtc->buffer_id = m->fb;
+		crtc->x = m->x;
+		crtc->y = m->y;
+		crtc->width = m->mode.hdisplay;
+		crtc->height = m->mode.vdisplay;
+		crtc->mode_valid = 1;
+		crtc->mode = m->mode;
+	}
+	g_mutex_unlock(m->lock);
+
+	return crtc;
+}
+
+static drmModePlaneRes *
+memdev_get_plane_resources(struct device *dev)
+{
+	drmModePlaneRes *res;
+
+	res = calloc(1, sizeof(*res));
+	res->count_planes = 1;
+	res->planes = malloc(sizeof(uint32_t));
+	res->planes[0] = MEMDEV_PLANE_ID;
+
+	return res;
+}
+
+static drmModePlane *
+memdev_get_plane(struct device *dev, uint32_t id)
+{
+	struct memdev *m = dev->priv;
+	drmModePlane *plane;
+	unsigned int i;
+
+	if (id != MEMDEV_PLANE_ID) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	plane = calloc(1, sizeof(*plane));
+	plane->plane_id = id;
+	plane->possible_crtcs = 1;
+	plane->count_formats = nr_formats;
+	plane->formats = malloc(nr_formats * sizeof(uint32_t));
+	for (i = 0; i < nr_formats; i++)
+		plane->formats[i] = formats[i].drm_format;
+
+	g_mutex_lock(m->lock);
+	plane->crtc_id = m->plane_crtc;
+	plane->fb_id = m->plane_fb;
+	plane->crtc_x = m->plane_x;
+	plane->crtc_y = m->plane_y;
+	g_mutex_unlock(m->lock);
+
+	return plane;
+}
+
+/* called with the lock held */
+static struct fb *
+lookup_fb(struct memdev *m, uint32_t id)
+{
+	struct fb *fb;
+
+	fb = g_hash_table_lookup(m->fbs, GUINT_TO_POINTER(id));
+	if (!fb)
+		errno = ENOENT;
+
+	return fb;
+}
+
+static int
+memdev_set_crtc(struct device *dev, uint32_t crtc_id, uint32_t fb_id,
+		uint32_t x, uint32_t y, uint32_t *conns, int count,
+		drmModeModeInfo *mode)
+{
+	struct memdev *m = dev->priv;
+	struct fb *fb;
+	int ret = -1;
+
+	if (crtc_id != MEMDEV_CRTC_ID) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	g_mutex_lock(m->lock);
+
+	if (m->flip_pending) {
+		errno = EBUSY;
+		goto out;
+	}
+
+	if (!fb_id || !mode) {
+		m->active = false;
+		m->fb = 0;
+		ret = 0;
+		goto out;
+	}
+
+	if (count != 1 || conns[0] != MEMDEV_CONN_ID) {
+		errno = EINVAL;
+		goto out;
+	}
+
+	fb = lookup_fb(m, fb_id);
+	if (!fb)
+		goto out;
+
+	/* the framebuffer must cover the whole mode */
+	if (x + mode->hdisplay > fb->width || y + mode->vdisplay > fb->height) {
+		errno = ENOSPC;
+		goto out;
+	}
+
+	m->active = true;
+	m->mode = *mode;
+	m->fb = fb_id;
+	m->x = x;
+	m->y = y;
+	m->period = mode_period(mode);
+	m->epoch = g_get_monotonic_time();
+
+	dump_fb(m, fb_id);
+	ret = 0;
+
+out:
+	g_mutex_unlock(m->lock);
+
+	return ret;
+}
+
+static int
+memdev_set_plane(struct device *dev, uint32_t plane_id, uint32_t crtc_id,
+		uint32_t fb_id, uint32_t flags,
+		int32_t crtc_x, int32_t crtc_y, uint32_t crtc_w, uint32_t crtc_h,
+		uint32_t src_x, uint32_t src_y, uint32_t src_w, uint32_t src_h)
+{
+	struct memdev *m = dev->priv;
+	struct fb *fb;
+	gint64 wait = 0;
+
+	if (plane_id != MEMDEV_PLANE_ID || (fb_id && crtc_id != MEMDEV_CRTC_ID)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	g_mutex_lock(m->lock);
+
+	if (fb_id) {
+		fb = lookup_fb(m, fb_id);
+		if (!fb) {
+			g_mutex_unlock(m->lock);
+			return -1;
+		}
+
+		/* 16.16 source inside the framebuffer */
+		if ((src_x >> 16) + (src_w >> 16) > fb->width ||
+				(src_y >> 16) + (src_h >> 16) > fb->height) {
+			g_mutex_unlock(m->lock);
+			errno = ENOSPC;
+			return -1;
+		}
+
+		if (m->active)
+			wait = next_vblank(m, g_get_monotonic_time()) - g_get_monotonic_time();
+	}
+
+	g_mutex_unlock(m->lock);
+
+	/* latched at the next vblank */
+	if (wait > 0)
+		g_usleep(wait);
+
+	g_mutex_lock(m->lock);
+	m->plane_crtc = fb_id ? crtc_id : 0;
+	m->plane_fb = fb_id;
+	m->plane_x = crtc_x;
+	m->plane_y = crtc_y;
+	dump_fb(m, fb_id);
+	g_mutex_unlock(m->lock);
+
+	return 0;
+}
+
+static int
+memdev_page_flip(struct device *dev, uint32_t crtc_id, uint32_t fb_id,
+		uint32_t flags, void *data)
+{
+	struct memdev *m = dev->priv;
+	struct fb *fb;
+	int ret = -1;
+
+	if (crtc_id != MEMDEV_CRTC_ID) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	g_mutex_lock(m->lock);
+
+	if (!m->active) {
+		errno = EINVAL;
+		goto out;
+	}
+
+	if (m->flip_pending) {
+		errno = EBUSY;
+		goto out;
+	}
+
+	fb = lookup_fb(m, fb_id);
+	if (!fb)
+		goto out;
+
+	if (m->x + m->mode.hdisplay > fb->width || m->y + m->mode.vdisplay > fb->height) {
+		errno = ENOSPC;
+		goto out;
+	}
+
+	m->flip_pending = true;
+	m->flip_fb = fb_id;
+	m->flip_event = flags & DRM_MODE_PAGE_FLIP_EVENT;
+	m->flip_data = data;
+	m->flip_due = next_vblank(m, g_get_monotonic_time());
+
+	arm(dev, m->flip_due);
+	ret = 0;
+
+out:
+	g_mutex_unlock(m->lock);
+
+	return ret;
+}
+
+static int
+memdev_dirty_fb(struct device *dev, uint32_t fb_id, drmModeClip *clips, uint32_t count)
+{
+	struct memdev *m = dev->priv;
+	int ret;
+
+	g_mutex_lock(m->lock);
+	ret = lookup_fb(m, fb_id) ? 0 : -1;
+	g_mutex_unlock(m->lock);
+
+	return ret;
+}
+
+static int
+memdev_handle_event(struct device *dev, drmEventContext *ctx)
+{
+	struct memdev *m = dev->priv;
+	uint64_t expirations;
+	bool event;
+	void *data;
+	gint64 due;
+	unsigned int sequence;
+
+	/* EAGAIN when another thread got here first, like a drm fd */
+	if (read(dev->fd, &expirations, sizeof(expirations)) < 0)
+		return -1;
+
+	g_mutex_lock(m->lock);
+
+	if (!m->flip_pending || m->flip_due > g_get_monotonic_time()) {
+		g_mutex_unlock(m->lock);
+		return 0;
+	}
+
+	m->flip_pending = false;
+	if (m->active) {
+		m->fb = m->flip_fb;
+		dump_fb(m, m->fb);
+	}
+
+	event = m->flip_event;
+	data = m->flip_data;
+	due = m->flip_due;
+	sequence = (due - m->epoch) / m->period;
+
+	g_mutex_unlock(m->lock);
+
+	if (event && ctx->page_flip_handler)
+		ctx->page_flip_handler(dev->fd, sequence,
+				due / G_USEC_PER_SEC, due % G_USEC_PER_SEC, data);
+
+	return 0;
+}
+
+static int
+memdev_add_fb2(struct device *dev, uint32_t width, uint32_t height,
+		uint32_t format, const uint32_t handles[4], const uint32_t pitches[4],
+		const uint32_t offsets[4], uint32_t *fb_id, uint32_t flags)
+{
+	struct memdev *m = dev->priv;
+	struct fb *fb;
+	struct layout layout;
+	unsigned int i;
+
+	fb = g_new0(struct fb, 1);
+	fb->width = width;
+	fb->height = height;
+
+	fb->format = format_by_drm(format);
+	if (!fb->format || !width || !height) {
+		g_free(fb);
+		errno = EINVAL;
+		return -1;
+	}
+
+	format_bo_layout(fb->format, width, height, pitches[0], &layout);
+
+	g_mutex_lock(m->lock);
+
+	for (i = 0; i < layout.planes; i++) {
+		struct bo *bo = g_hash_table_lookup(m->bos, GUINT_TO_POINTER(handles[i]));
+
+		if (!bo || pitches[i] < layout.row_bytes[i] ||
+				offsets[i] + (size_t) pitches[i] * layout.rows[i] > bo->size) {
+			g_mutex_unlock(m->lock);
+			g_free(fb);
+			errno = bo ? EINVAL : ENOENT;
+			return -1;
+		}
+
+		fb->bos[i] = bo;
+		fb->pitches[i] = pitches[i];
+		fb->offsets[i] = offsets[i];
+	}
+
+	fb->id = ++m->next_id;
+	g_hash_table_insert(m->fbs, GUINT_TO_POINTER(fb->id), fb);
+
+	g_mutex_unlock(m->lock);
+
+	*fb_id = fb->id;
+
+	return 0;
+}
+
+static int
+memdev_rm_fb(struct device *dev, uint32_t fb_id)
+{
+	struct memdev *m = dev->priv;
+	int ret = 0;
+
+	g_mutex_lock(m->lock);
+
+	if (!g_hash_table_remove(m->fbs, GUINT_TO_POINTER(fb_id))) {
+		errno = ENOENT;
+		ret = -1;
+	}
+
+	/* like the kernel, removing what is on screen turns it off */
+	if (m->fb == fb_id || (m->flip_pending && m->flip_fb == fb_id)) {
+		m->active = false;
+		m->fb = 0;
+	}
+
+	if (m->plane_fb == fb_id) {
+		m->plane_fb = 0;
+		m->plane_crtc = 0;
+	}
+
+	g_mutex_unlock(m->lock);
+
+	return ret;
+}
+
+static void *
+memdev_bo_create(struct device *dev, uint32_t width, uint32_t height,
+		uint32_t *handle, uint32_t *pitch, void **map)
+{
+	struct memdev *m = dev->priv;
+	struct bo *bo;
+
+	bo = g_new0(struct bo, 1);
+	bo->pitch = ROUND_UP(width * 4, 64);
+	bo->size = (size_t) bo->pitch * height;
+	bo->data = g_malloc0(bo->size);
+
+	g_mutex_lock(m->lock);
+	bo->handle = ++m->next_id;
+	g_hash_table_insert(m->bos, GUINT_TO_POINTER(bo->handle), bo);
+	g_mutex_unlock(m->lock);
+
+	*handle = bo->handle;
+	*pitch = bo->pitch;
+	*map = bo->data;
+
+	return bo;
+}
+
+static void
+memdev_bo_destroy(struct device *dev, void *data)
+{
+	struct memdev *m = dev->priv;
+	struct bo *bo = data;
+
+	g_mutex_lock(m->lock);
+	g_hash_table_remove(m->bos, GUINT_TO_POINTER(bo->handle));
+	g_mutex_unlock(m->lock);
+}
+
+/* our buffers are plain memory, there is no dma-buf to hand out */
+static int
+memdev_prime_handle_to_fd(struct device *dev, uint32_t handle, uint32_t flags, int *dmabuf)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+const struct device_funcs memdev_funcs = {
+	.open = memdev_open,
+	.close = memdev_close,
+	.get_cap = memdev_get_cap,
+	.set_client_cap = memdev_set_client_cap,
+	.get_resources = memdev_get_resources,
+	.get_connector = memdev_get_connector,
+	/* nothing to probe */
+	.get_connector_current = memdev_get_connector,
+	.get_encoder = memdev_get_encoder,
+	.get_crtc = memdev_get_crtc,
+	.get_plane_resources = memdev_get_plane_resources,
+	.get_plane = memdev_get_plane,
+	.set_crtc = memdev_set_crtc,
+	.set_plane = memdev_set_plane,
+	.page_flip = memdev_page_flip,
+	.dirty_fb = memdev_dirty_fb,
+	.handle_event = memdev_handle_event,
+	.add_fb2 = memdev_add_fb2,
+	.rm_fb = memdev_rm_fb,
+	.bo_create = memdev_bo_create,
+	.bo_destroy = memdev_bo_destroy,
+	.prime_handle_to_fd = memdev_prime_handle_to_fd,
+};
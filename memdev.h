@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef MEMDEV_H
+#define MEMDEV_H
+
+#include "device.h"
+
+/*
+ * A DRM device in memory, for running the sinks without a display:
+ *
+ *   device=memory[:WIDTHxHEIGHT[@HZ]][,dump=FILE]
+ *
+ * One connector with the given preferred mode (1920x1080@60 by default)
+ * and a couple of smaller ones, one crtc and one overlay plane taking
+ * every format we know, on fixed ids. Buffers live in plain memory, page
+ * flips complete on a vblank timeline that starts at the modeset, and
+ * the fd is a timerfd that fires at the next pending vblank. Legacy plane
+ * updates block until the vblank that latches them.
+ *
+ * With dump, every framebuffer that reaches the screen is appended to
+ * FILE, planes tightly packed in the framebuffer's own format.
+ *
+ * No atomic, no PRIME.
+ */
+
+#define MEMDEV_PREFIX	"memory"
+
+#define MEMDEV_CRTC_ID	10
+#define MEMDEV_ENCODER_ID	11
+#define MEMDEV_CONN_ID	12
+#define MEMDEV_PLANE_ID	13
+
+extern const struct device_funcs memdev_funcs;
+
+#endif /* MEMDEV_H */
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "pacing.h"
+#include "present.h"
+#include "device.h"
+
+#include <stdio.h>
+
+#include <xf86drm.h>
+
+/* flip event timestamps have to be comparable with g_get_monotonic_time() */
+bool
+pacing_supported(struct device *dev)
+{
+	uint64_t value = 0;
+
+	if (device_get_cap(dev, DRM_CAP_TIMESTAMP_MONOTONIC, &value) || !value) {
+		fprintf(stderr, "no monotonic vblank timestamps, pacing disabled\n");
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * The monotonic time the buffer is due on screen: when GstBaseSink would
+ * render it with no render delay. 0 when it isn't synced to a clock.
+ */
+gint64
+pacing_target(GstBaseSink *base, GstBuffer *buffer)
+{
+	GstClockTime timestamp, running, now;
+	GstClockTimeDiff ahead;
+	GstClock *clock;
+
+	timestamp = GST_BUFFER_TIMESTAMP(buffer);
+	if (!gst_base_sink_get_sync(base) || !GST_CLOCK_TIME_IS_VALID(timestamp))
+		return 0;
+
+	running = gst_segment_to_running_time(&base->segment, GST_FORMAT_TIME, timestamp);
+	if (!GST_CLOCK_TIME_IS_VALID(running))
+		return 0;
+
+	clock = gst_element_get_clock(GST_ELEMENT(base));
+	if (!clock)
+		return 0;
+
+	now = gst_clock_get_time(clock);
+	gst_object_unref(clock);
+
+	ahead = (GstClockTimeDiff) (gst_element_get_base_time(GST_ELEMENT(base)) + running +
+			gst_base_sink_get_latency(base)) + gst_base_sink_get_ts_offset(base) - (GstClockTimeDiff) now;
+
+	return g_get_monotonic_time() + ahead / (GstClockTimeDiff) GST_USECOND;
+}
+
+/*
+ * Paced frames have to reach render() ahead of their time, by as much as
+ * the flips measurably take. That lead goes to GstBaseSink as the render
+ * delay, so it both syncs early and reports it as latency.
+ */
+void
+pacing_update_delay(GstBaseSink *base, struct present *present, gint64 *delay)
+{
+	gint64 lead;
+
+	lead = present_lead(present);
+
+	/* every change posts a latency message, follow only real moves */
+	if (ABS(lead - *delay) < 1000)
+		return;
+
+	*delay = lead;
+	gst_base_sink_set_render_delay(base, lead * GST_USECOND);
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef PACING_H
+#define PACING_H
+
+#include <stdbool.h>
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+struct device;
+struct present;
+
+/*
+ * Frame pacing: instead of flipping whatever render() got as soon as
+ * possible, every buffer is held until the vblank closest to the moment
+ * its running time comes up on the pipeline clock.
+ */
+
+bool pacing_supported(struct device *dev);
+gint64 pacing_target(GstBaseSink *base, GstBuffer *buffer);
+void pacing_update_delay(GstBaseSink *base, struct present *present, gint64 *delay);
+
+#endif /* PACING_H */
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "pool.h"
+#include "format.h"
+#include "device.h"
+#include "prime.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <xf86drm.h>
+
+struct pool {
+	gchar *device;
+	struct device *dev;
+	unsigned int refcount;
+	struct prime *prime;
+
+	GMutex *lock;
+	/* least recently used first */
+	struct pool_buffer *buffers;
+	size_t idle;
+	size_t limit;		/* the sum of what the sinks using it asked for */
+
+	struct pool *next;
+};
+
+G_LOCK_DEFINE_STATIC(pools);
+static struct pool *pools;
+
+static struct pool_buffer *
+buffer_new(struct pool *pool, const struct format *format,
+		uint32_t width, uint32_t height)
+{
+	struct pool_buffer *buffer;
+	struct layout layout;
+	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
+	uint32_t bo_width, bo_height;
+	unsigned int i;
+
+	buffer = g_new0(struct pool_buffer, 1);
+	buffer->dmabuf = -1;
+	buffer->format = format;
+	buffer->width = width;
+	buffer->height = height;
+
+	/* libkms only has 32bpp buffers, big enough for every plane */
+	format_bo_size(format, width, height, &bo_width, &bo_height);
+
+	buffer->bo = device_bo_create(pool->dev, bo_width, bo_height,
+			&buffer->handle, &buffer->pitch, (void **) &buffer->frame);
+	if (!buffer->bo)
+		goto err_create;
+
+	format_bo_layout(format, width, height, buffer->pitch, &layout);
+
+	for (i = 0; i < layout.planes; i++) {
+		handles[i] = buffer->handle;
+		pitches[i] = layout.pitch[i];
+		offsets[i] = layout.offset[i];
+	}
+
+	if (device_add_fb2(pool->dev, width, height, format->drm_format,
+			handles, pitches, offsets, &buffer->fb, 0)) {
+		perror("failed drmModeAddFB2()");
+		goto err_bo;
+	}
+
+	buffer->size = (size_t) buffer->pitch * bo_height;
+
+	return buffer;
+
+err_bo:
+	device_bo_destroy(pool->dev, buffer->bo);
+err_create:
+	g_free(buffer);
+	return NULL;
+}
+
+static void
+buffer_free(struct pool *pool, struct pool_buffer *buffer)
+{
+	if (buffer->dmabuf >= 0) {
+		if (pool->prime)
+			prime_disown(pool->prime, buffer->handle);
+		close(buffer->dmabuf);
+	}
+
+	device_rm_fb(pool->dev, buffer->fb);
+	device_bo_destroy(pool->dev, buffer->bo);
+	g_free(buffer);
+}
+
+static void
+free_buffers(struct pool *pool, struct pool_buffer *buffer)
+{
+	struct pool_buffer *next;
+
+	for (; buffer; buffer = next) {
+		next = buffer->next;
+		buffer_free(pool, buffer);
+	}
+}
+
+/*
+ * Unlink least recently used idle buffers until we are within the limit.
+ * The caller frees them with free_buffers() once it dropped the lock.
+ */
+static struct pool_buffer *
+trim(struct pool *pool)
+{
+	struct pool_buffer **p = &pool->buffers, *buffer, *victims = NULL;
+
+	while (*p && pool->idle > pool->limit) {
+		buffer = *p;
+		if (buffer->in_use) {
+			p = &buffer->next;
+			continue;
+		}
+
+		*p = buffer->next;
+		pool->idle -= buffer->size;
+		buffer->next = victims;
+		victims = buffer;
+	}
+
+	return victims;
+}
+
+struct pool *
+pool_open(const char *device, size_t limit)
+{
+	struct pool *pool;
+
+	G_LOCK(pools);
+
+	for (pool = pools; pool; pool = pool->next) {
+		if (strcmp(pool->device, device) == 0) {
+			pool->refcount++;
+			g_mutex_lock(pool->lock);
+			pool->limit += limit;
+			g_mutex_unlock(pool->lock);
+			goto out;
+		}
+	}
+
+	pool = g_new0(struct pool, 1);
+
+	pool->dev = device_open(device);
+	if (!pool->dev) {
+		g_free(pool);
+		pool = NULL;
+		goto out;
+	}
+
+	pool->device = g_strdup(device);
+	pool->refcount = 1;
+	pool->limit = limit;
+	pool->lock = g_mutex_new();
+	pool->prime = prime_new(pool->dev);
+
+	pool->next = pools;
+	pools = pool;
+
+out:
+	G_UNLOCK(pools);
+
+	return pool;
+}
+
+void
+pool_unref(struct pool *pool, size_t limit)
+{
+	struct pool **p;
+	struct pool_buffer *victims;
+
+	G_LOCK(pools);
+
+	if (--pool->refcount) {
+		/* the others keep their share of idle buffers */
+		g_mutex_lock(pool->lock);
+		pool->limit -= MIN(limit, pool->limit);
+		victims = trim(pool);
+		g_mutex_unlock(pool->lock);
+		G_UNLOCK(pools);
+
+		free_buffers(pool, victims);
+		return;
+	}
+
+	for (p = &pools; *p != pool; p = &(*p)->next);
+	*p = pool->next;
+
+	G_UNLOCK(pools);
+
+	free_buffers(pool, pool->buffers);
+
+	if (pool->prime)
+		prime_free(pool->prime);
+	device_close(pool->dev);
+
+	g_mutex_free(pool->lock);
+	g_free(pool->device);
+	g_free(pool);
+}
+
+struct device *
+pool_device(struct pool *pool)
+{
+	return pool->dev;
+}
+
+struct prime *
+pool_prime(struct pool *pool)
+{
+	return pool->prime;
+}
+
+struct pool_buffer *
+pool_get(struct pool *pool, const struct format *format,
+		uint32_t width, uint32_t height)
+{
+	struct pool_buffer **p, *buffer;
+
+	g_mutex_lock(pool->lock);
+
+	for (p = &pool->buffers; (buffer = *p); p = &buffer->next) {
+		if (!buffer->in_use && buffer->format == format &&
+				buffer->width == width && buffer->height == height) {
+			*p = buffer->next;
+			pool->idle -= buffer->size;
+			break;
+		}
+	}
+
+	g_mutex_unlock(pool->lock);
+
+	/* no ioctls under the lock */
+	if (!buffer)
+		buffer = buffer_new(pool, format, width, height);
+	if (!buffer)
+		return NULL;
+
+	buffer->in_use = true;
+
+	/* in use buffers sit at the tail, out of the way of trim() */
+	g_mutex_lock(pool->lock);
+	for (p = &pool->buffers; *p; p = &(*p)->next);
+	buffer->next = NULL;
+	*p = buffer;
+	g_mutex_unlock(pool->lock);
+
+	return buffer;
+}
+
+void
+pool_put(struct pool *pool, struct pool_buffer *buffer)
+{
+	struct pool_buffer **p, *victims;
+
+	g_mutex_lock(pool->lock);
+
+	/* most recently used to the tail */
+	for (p = &pool->buffers; *p != buffer; p = &(*p)->next);
+	*p = buffer->next;
+	for (; *p; p = &(*p)->next);
+	buffer->next = NULL;
+	*p = buffer;
+
+	buffer->in_use = false;
+	pool->idle += buffer->size;
+	victims = trim(pool);
+
+	g_mutex_unlock(pool->lock);
+
+	free_buffers(pool, victims);
+}
+
+/* a dma-buf of the buffer for producers that can't use our mapping */
+int
+pool_export(struct pool *pool, struct pool_buffer *buffer)
+{
+	if (buffer->dmabuf >= 0)
+		return buffer->dmabuf;
+
+	if (device_prime_handle_to_fd(pool->dev, buffer->handle, DRM_CLOEXEC | DRM_RDWR, &buffer->dmabuf)) {
+		perror("failed drmPrimeHandleToFD()");
+		buffer->dmabuf = -1;
+	} else if (pool->prime) {
+		prime_own(pool->prime, buffer->handle);
+	}
+
+	return buffer->dmabuf;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+struct device;
+struct format;
+struct pool;
+struct prime;
+
+/* a mapped scanout buffer with its framebuffer */
+struct pool_buffer {
+	void *bo;
+	unsigned char *frame;
+	uint32_t handle;
+	uint32_t pitch;
+	uint32_t fb;
+	int dmabuf;		/* exported on demand, -1 until then */
+	/* a GstBuffer handed to upstream still points into it */
+	volatile gint upstream;
+
+	/* cache key */
+	const struct format *format;
+	uint32_t width;
+	uint32_t height;
+
+	size_t size;
+	bool in_use;
+	struct pool_buffer *next;
+};
+
+/*
+ * One pool per device, shared by the sinks of one plugin that use it, so
+ * they share the fd too. Each plugin links its own copy and GStreamer loads
+ * it with G_MODULE_BIND_LOCAL: a drmsink and a drmcompsink in the same
+ * process have a pool and an fd each, and only one of them gets to be
+ * DRM master.
+ *
+ * Each sink adds the bytes of idle buffers it wants kept for reuse to the
+ * pool's limit when it opens it, and takes the same back when it lets go.
+ */
+struct pool *pool_open(const char *device, size_t limit);
+void pool_unref(struct pool *pool, size_t limit);
+struct device *pool_device(struct pool *pool);
+
+/* the import cache of the fd, NULL when the driver can't import */
+struct prime *pool_prime(struct pool *pool);
+
+struct pool_buffer *pool_get(struct pool *pool, const struct format *format,
+		uint32_t width, uint32_t height);
+void pool_put(struct pool *pool, struct pool_buffer *buffer);
+
+int pool_export(struct pool *pool, struct pool_buffer *buffer);
+
+#endif /* POOL_H */
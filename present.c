@@ -0,0 +1,626 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "present.h"
+#include "ring.h"
+#include "stats.h"
+#include "device.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include <xf86drm.h>
+
+#define FLIP_TIMEOUT	1000 /* ms */
+#define SUBMIT_MARGIN	1000 /* usec after the vblank before the target one */
+#define LATE_MARGIN	2000 /* usec, later than this before a vblank misses it */
+
+struct present {
+	struct device *dev;
+	struct ring *ring;
+	present_flip_func flip;
+	present_done_func done;
+	bool async;
+	void *data;
+
+	GThread *thread;
+	int wake[2];
+
+	volatile gint running;
+	volatile gint flushing;
+	volatile gint failed;
+	volatile gint flip_pending;
+
+	/* one flip event per crtc, the flip is done with the last */
+	unsigned int events;
+	volatile gint events_left;
+
+	struct stats *stats;
+	struct page *flipping;
+	gint64 submitted;
+	bool skipped;		/* the flip function had nothing to show */
+
+	/*
+	 * Pacing: the crtc's vblank timeline, from flip event timestamps, under
+	 * the lock. Vblanks are counted from the first one seen.
+	 */
+	bool pacing;
+	gint64 period;		/* usec, refined from the timestamps */
+	gint64 vblank;		/* time of the last one seen, 0 before the first */
+	gint64 index;
+	unsigned int sequence;
+	gint64 flip_latency;	/* submit to vblank, usec */
+
+	/* presentation thread only */
+	gint64 scheduled;	/* vblank the last page was flipped for */
+	double phase;		/* vblank units, keeps the cadence off rounding edges */
+
+	/*
+	 * Single producer (streaming thread), single consumer (presentation
+	 * thread). There are never more pages in flight than slots.
+	 */
+	struct page *slots[RING_MAX_SLOTS];
+	volatile gint head;
+	volatile gint tail;
+
+	/* only for sleeping; signalled when a page is freed */
+	GMutex *lock;
+	GCond *cond;
+};
+
+static void
+wakeup(struct present *p)
+{
+	char c = 0;
+
+	if (write(p->wake[1], &c, 1) < 0 && errno != EAGAIN)
+		perror("failed write(wake)");
+}
+
+static void
+signal_waiters(struct present *p)
+{
+	g_mutex_lock(p->lock);
+	g_cond_broadcast(p->cond);
+	g_mutex_unlock(p->lock);
+}
+
+static void
+fail(struct present *p)
+{
+	g_atomic_int_set(&p->failed, 1);
+	signal_waiters(p);
+}
+
+static void
+flip_complete(struct present *p)
+{
+	g_mutex_lock(p->lock);
+	ring_flip_done(p->ring);
+	/* before the next flip can start */
+	if (p->done)
+		p->done(p->data);
+	g_atomic_int_set(&p->flip_pending, 0);
+	g_cond_broadcast(p->cond);
+	g_mutex_unlock(p->lock);
+}
+
+/* before flip_complete(), the page may be reused right after it */
+static void
+flip_stats(struct present *p)
+{
+	if (!p->stats || !p->flipping)
+		return;
+
+	stats_latency(p->stats, STATS_DISPLAY, g_get_monotonic_time() - p->flipping->queued);
+	stats_count(p->stats, STATS_PRESENTED);
+	p->flipping = NULL;
+}
+
+/*
+ * A flip completed at the vblank at time. Synchronous flips don't know the
+ * sequence, the completion time stands in for the timestamp.
+ */
+static void
+vblank_seen(struct present *p, gint64 time, bool has_sequence, unsigned int sequence)
+{
+	gint64 n, period;
+
+	g_mutex_lock(p->lock);
+
+	if (p->vblank) {
+		if (has_sequence)
+			n = (int) (sequence - p->sequence);
+		else
+			n = (time - p->vblank + p->period / 2) / p->period;
+
+		if (n > 0) {
+			/* refined slowly, a late timestamp must not move the timeline */
+			period = (time - p->vblank) / n;
+			if (period > p->period * 9 / 10 && period < p->period * 11 / 10)
+				p->period += (period - p->period) / 8;
+			p->index += n;
+		}
+	}
+
+	p->vblank = time;
+	p->sequence = has_sequence ? sequence : p->sequence + 1;
+
+	if (p->submitted && time > p->submitted)
+		p->flip_latency += (time - p->submitted - p->flip_latency) / 8;
+	p->submitted = 0;
+
+	g_mutex_unlock(p->lock);
+}
+
+static void
+page_flip_handler(int fd, unsigned int frame,
+		unsigned int sec, unsigned int usec, void *data)
+{
+	struct present *p = data;
+
+	trace(TRACE_FLIP_DONE, p->data, frame);
+
+	if (!g_atomic_int_dec_and_test(&p->events_left))
+		return;
+
+	/* the sequence counts are per crtc, only one crtc has a single timeline */
+	if (p->pacing)
+		vblank_seen(p, (gint64) sec * 1000000 + usec, p->events == 1, frame);
+	flip_stats(p);
+	flip_complete(p);
+
+	/* the fd is shared, this may be another sink's thread */
+	wakeup(p);
+}
+
+static struct page *
+pop(struct present *p)
+{
+	struct page *page;
+	gint tail = p->tail;
+
+	if (tail == g_atomic_int_get(&p->head))
+		return NULL;
+
+	page = p->slots[tail % RING_MAX_SLOTS];
+	g_atomic_int_set(&p->tail, tail + 1);
+
+	return page;
+}
+
+/*
+ * The vblank to show a paced page on: the one closest to its target, with
+ * the rounding point steered so a steady cadence stays away from it. A 24
+ * fps stream on 60 Hz then alternates 2 and 3 vblanks every time, instead
+ * of whatever the jitter of the moment decides.
+ *
+ * Returns the usec to wait before flipping it, 0 to flip it now, or -1 when
+ * the page should give way to the newer one behind it.
+ */
+static gint64
+schedule(struct present *p, struct page *page, bool newer)
+{
+	gint64 now, vblank, period, index, n, due, wait;
+	double pos, r;
+
+	if (!p->pacing || !page->target || g_atomic_int_get(&p->flushing))
+		return 0;
+
+	g_mutex_lock(p->lock);
+	vblank = p->vblank;
+	period = p->period;
+	index = p->index;
+	g_mutex_unlock(p->lock);
+
+	/* no timeline yet, this flip starts it */
+	if (!vblank)
+		return 0;
+
+	now = g_get_monotonic_time();
+	pos = index + (double) (page->target - vblank) / period;
+	r = pos - p->phase + 0.5;
+	n = (gint64) r - (r < 0 && r != (gint64) r);
+	r -= n + 0.5;
+
+	/* a seek or a new segment, start over */
+	if (n + 1 < p->scheduled)
+		p->scheduled = 0;
+
+	if (p->scheduled && n <= p->scheduled) {
+		/* faster than the refresh, two pages for one vblank */
+		if (newer)
+			return -1;
+		n = p->scheduled + 1;
+		r = 0;
+	}
+
+	due = vblank + (n - index) * period;
+
+	/* flipped any earlier it would land on the vblank before */
+	wait = due - period + SUBMIT_MARGIN - now;
+	if (wait > 0)
+		return wait;
+
+	if (now > due - LATE_MARGIN) {
+		if (newer)
+			return -1;
+		/* the next vblank is the best we can do */
+		n = index + (now - vblank) / period + 1;
+		r = 0;
+	}
+
+	p->scheduled = n;
+	p->phase = CLAMP(p->phase + r / 8, -0.5, 0.5);
+
+	return 0;
+}
+
+/* a page for a vblank that went to a newer one */
+static void
+drop(struct present *p, struct page *page)
+{
+	trace(TRACE_DROP, p->data, page->fb);
+	if (p->stats)
+		stats_count(p->stats, STATS_DROPPED);
+	ring_set_state(page, PAGE_FREE);
+	signal_waiters(p);
+}
+
+/* usec until the next page is due, 0 if it was flipped or there is none */
+static gint64
+flip_next(struct present *p)
+{
+	struct page *page;
+	gint64 start, wait;
+
+	while (1) {
+		if (p->tail == g_atomic_int_get(&p->head))
+			return 0;
+
+		page = p->slots[p->tail % RING_MAX_SLOTS];
+		wait = schedule(p, page, p->tail + 1 != g_atomic_int_get(&p->head));
+		if (wait >= 0)
+			break;
+
+		drop(p, pop(p));
+	}
+
+	if (wait > 0)
+		return wait;
+
+	/* raised before the slot is consumed so present_drain() never sees idle */
+	g_atomic_int_set(&p->flip_pending, 1);
+	g_atomic_int_set(&p->events_left, p->events);
+
+	page = pop(p);
+	ring_set_state(page, PAGE_QUEUED);
+	p->flipping = page;
+
+	start = g_get_monotonic_time();
+
+	if (p->pacing) {
+		g_mutex_lock(p->lock);
+		p->submitted = start;
+		g_mutex_unlock(p->lock);
+	}
+
+	if (!p->flip(p->data, page)) {
+		p->flipping = NULL;
+		g_atomic_int_set(&p->flip_pending, 0);
+		ring_set_state(page, PAGE_FREE);
+		fail(p);
+		return 0;
+	}
+
+	/* no event will come, the page is done with */
+	if (p->skipped) {
+		p->skipped = false;
+		p->flipping = NULL;
+		g_atomic_int_set(&p->flip_pending, 0);
+		ring_set_state(page, PAGE_FREE);
+		signal_waiters(p);
+		return 0;
+	}
+
+	trace(TRACE_FLIP, p->data, page->fb);
+
+	if (p->stats)
+		stats_latency(p->stats, STATS_FLIP, g_get_monotonic_time() - start);
+
+	if (!p->async) {
+		trace(TRACE_FLIP_DONE, p->data, 0);
+		/* returns once the new page is latched */
+		if (p->pacing)
+			vblank_seen(p, g_get_monotonic_time(), false, 0);
+		flip_stats(p);
+		flip_complete(p);
+	}
+
+	return 0;
+}
+
+static gpointer
+present_thread(gpointer data)
+{
+	struct present *p = data;
+	drmEventContext evctx = {
+		.version = DRM_EVENT_CONTEXT_VERSION,
+		.page_flip_handler = page_flip_handler,
+	};
+	struct pollfd pfd[2] = {
+		{ .fd = p->dev->fd, .events = POLLIN },
+		{ .fd = p->wake[0], .events = POLLIN },
+	};
+	struct timespec ts;
+	char buf[32];
+	gint64 wait;
+	int ret;
+
+	while (g_atomic_int_get(&p->running)) {
+		wait = 0;
+		if (!g_atomic_int_get(&p->flip_pending)) {
+			wait = flip_next(p);
+
+			/* a synchronous flip is done, the next page may be waiting */
+			if (!wait && !g_atomic_int_get(&p->flip_pending) &&
+					!g_atomic_int_get(&p->failed) &&
+					p->tail != g_atomic_int_get(&p->head))
+				continue;
+		}
+
+		if (g_atomic_int_get(&p->flip_pending))
+			wait = FLIP_TIMEOUT * 1000;
+
+		/* a paced page sleeps here until its vblank comes close */
+		ts.tv_sec = wait / 1000000;
+		ts.tv_nsec = wait % 1000000 * 1000;
+
+		ret = ppoll(pfd, 2, wait ? &ts : NULL, NULL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("failed poll(drm)");
+			fail(p);
+			break;
+		}
+
+		if (ret == 0 && !g_atomic_int_get(&p->flip_pending))
+			continue;
+
+		if (ret == 0) {
+			fprintf(stderr, "page flip timed out\n");
+			flip_complete(p);
+			fail(p);
+			continue;
+		}
+
+		if (pfd[1].revents & POLLIN)
+			while (read(p->wake[0], buf, sizeof(buf)) > 0);
+
+		if (pfd[0].revents & POLLIN) {
+			/* another thread sharing the fd may have read it first */
+			if (device_handle_event(p->dev, &evctx) && errno != EAGAIN) {
+				perror("failed drmHandleEvent()");
+				fail(p);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+struct present *
+present_new(struct device *dev, struct ring *ring,
+		present_flip_func flip, bool async, void *data)
+{
+	struct present *p;
+
+	p = g_new0(struct present, 1);
+
+	p->dev = dev;
+	p->ring = ring;
+	p->flip = flip;
+	p->async = async;
+	p->data = data;
+	p->events = 1;
+
+	if (pipe2(p->wake, O_CLOEXEC | O_NONBLOCK)) {
+		perror("failed pipe2()");
+		g_free(p);
+		return NULL;
+	}
+
+	p->lock = g_mutex_new();
+	p->cond = g_cond_new();
+	p->running = 1;
+
+	p->thread = g_thread_create(present_thread, p, TRUE, NULL);
+	if (!p->thread) {
+		fprintf(stderr, "failed to create presentation thread\n");
+		close(p->wake[0]);
+		close(p->wake[1]);
+		g_cond_free(p->cond);
+		g_mutex_free(p->lock);
+		g_free(p);
+		return NULL;
+	}
+
+	return p;
+}
+
+void
+present_free(struct present *p)
+{
+	present_drain(p);
+
+	g_atomic_int_set(&p->running, 0);
+	wakeup(p);
+	g_thread_join(p->thread);
+
+	close(p->wake[0]);
+	close(p->wake[1]);
+	g_cond_free(p->cond);
+	g_mutex_free(p->lock);
+	g_free(p);
+}
+
+/* block only when every page is busy */
+static struct page *
+wait_page(struct present *p, struct page *(*get)(struct ring *ring))
+{
+	struct page *page;
+
+	page = get(p->ring);
+	if (page)
+		return page;
+
+	g_mutex_lock(p->lock);
+	while (!(page = get(p->ring))) {
+		if (g_atomic_int_get(&p->flushing) || g_atomic_int_get(&p->failed))
+			break;
+		g_cond_wait(p->cond, p->lock);
+	}
+	g_mutex_unlock(p->lock);
+
+	return page;
+}
+
+struct page *
+present_get_page(struct present *p)
+{
+	return wait_page(p, ring_get_free);
+}
+
+/* a slot for an upstream dma-buf, freed by its flip like our pages */
+struct page *
+present_get_import(struct present *p)
+{
+	return wait_page(p, ring_get_import);
+}
+
+bool
+present_queue(struct present *p, struct page *page)
+{
+	gint head = p->head;
+
+	if (g_atomic_int_get(&p->failed))
+		return false;
+
+	page->queued = g_get_monotonic_time();
+	ring_set_state(page, PAGE_READY);
+	trace(TRACE_QUEUE, p->data, page->fb);
+
+	p->slots[head % RING_MAX_SLOTS] = page;
+	g_atomic_int_set(&p->head, head + 1);
+
+	wakeup(p);
+
+	return true;
+}
+
+/* from the flip function, when it turned out to have nothing to show */
+void
+present_skip(struct present *p)
+{
+	p->skipped = true;
+}
+
+/* upstream let go of a page, from any thread */
+void
+present_page_released(struct present *p)
+{
+	signal_waiters(p);
+}
+
+/* wait until every queued page has been flipped */
+void
+present_drain(struct present *p)
+{
+	g_mutex_lock(p->lock);
+	while (g_atomic_int_get(&p->tail) != p->head ||
+			g_atomic_int_get(&p->flip_pending)) {
+		if (g_atomic_int_get(&p->failed))
+			break;
+		g_cond_wait(p->cond, p->lock);
+	}
+	g_mutex_unlock(p->lock);
+}
+
+void
+present_set_flushing(struct present *p, bool flushing)
+{
+	g_atomic_int_set(&p->flushing, flushing);
+	signal_waiters(p);
+	/* paced pages waiting for their vblank go out right away */
+	wakeup(p);
+}
+
+bool
+present_failed(struct present *p)
+{
+	return g_atomic_int_get(&p->failed);
+}
+
+/* set before the first frame is queued */
+void
+present_set_stats(struct present *p, struct stats *stats)
+{
+	p->stats = stats;
+}
+
+/* set before the first frame is queued */
+void
+present_set_events(struct present *p, unsigned int events)
+{
+	p->events = events;
+}
+
+/* set before the first frame is queued */
+void
+present_set_done(struct present *p, present_done_func done)
+{
+	p->done = done;
+}
+
+/*
+ * Hold pages with a target time until the vblank closest to it. Set before
+ * the first frame is queued; timestamps must be CLOCK_MONOTONIC.
+ */
+void
+present_set_pacing(struct present *p, const drmModeModeInfo *mode)
+{
+	p->period = (gint64) mode->htotal * mode->vtotal * 1000 / mode->clock;
+	if (mode->flags & DRM_MODE_FLAG_INTERLACE)
+		p->period /= 2;
+	p->flip_latency = p->period;
+	p->pacing = true;
+}
+
+/*
+ * How long before its target a paced page has to be queued: it waits for
+ * the vblank before the target one, rounding may pick a vblank half a period
+ * early, and the flip itself takes what it measurably takes.
+ */
+gint64
+present_lead(struct present *p)
+{
+	gint64 lead;
+
+	g_mutex_lock(p->lock);
+	lead = p->period + p->period / 2 + p->flip_latency;
+	g_mutex_unlock(p->lock);
+
+	return lead;
+}
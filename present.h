@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef PRESENT_H
+#define PRESENT_H
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include <xf86drmMode.h>
+
+struct device;
+struct page;
+struct stats;
+struct ring;
+struct present;
+
+/*
+ * Called on the presentation thread to put a page on screen. Asynchronous
+ * flips must request a page flip event with the present handle as user data.
+ */
+typedef bool (*present_flip_func)(void *data, struct page *page);
+
+/* the flip of the last page reached the screen, on whichever thread saw it */
+typedef void (*present_done_func)(void *data);
+
+struct present *present_new(struct device *dev, struct ring *ring,
+		present_flip_func flip, bool async, void *data);
+void present_free(struct present *p);
+
+struct page *present_get_page(struct present *p);
+struct page *present_get_import(struct present *p);
+bool present_queue(struct present *p, struct page *page);
+void present_skip(struct present *p);
+void present_page_released(struct present *p);
+void present_drain(struct present *p);
+void present_set_flushing(struct present *p, bool flushing);
+bool present_failed(struct present *p);
+void present_set_stats(struct present *p, struct stats *stats);
+/* async flips of several crtcs at once: the number of flip events they send */
+void present_set_events(struct present *p, unsigned int events);
+void present_set_done(struct present *p, present_done_func done);
+void present_set_pacing(struct present *p, const drmModeModeInfo *mode);
+gint64 present_lead(struct present *p);
+
+#endif /* PRESENT_H */
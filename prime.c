@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "prime.h"
+#include "format.h"
+#include "device.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+/*
+ * Entries are held while their framebuffer is queued or on screen and only
+ * idle ones are evicted; with every entry held a new dma-buf is copied.
+ */
+#define PRIME_CACHE_SIZE	32
+#define PRIME_REJECTS	8
+
+struct import {
+	/*
+	 * A dma-buf is identified by its GEM handle on our fd: the kernel hands
+	 * out the same one for every fd of the same buffer. Fd numbers get
+	 * reused, and before Linux 5.3 all dma-bufs share one inode.
+	 */
+	uint32_t handle;
+	const struct format *format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t offset[FORMAT_MAX_PLANES];
+	uint32_t pitch[FORMAT_MAX_PLANES];
+
+	uint32_t fb;
+	unsigned int used;
+	unsigned int refs;		/* until prime_release() */
+};
+
+/*
+ * A dma-buf we couldn't get a handle for. Without a handle only the fd and
+ * its inode tell buffers apart, which may mistake a later buffer for it:
+ * that one is copied instead, never scanned out wrong.
+ */
+struct reject {
+	int fd;
+	dev_t dev;
+	ino_t ino;
+	unsigned int used;
+};
+
+struct prime {
+	struct device *dev;
+	int fd;
+
+	/* every sink on the fd imports through here */
+	GMutex *lock;
+	struct import cache[PRIME_CACHE_SIZE];
+	unsigned int count;
+	unsigned int clock;
+
+	struct reject rejects[PRIME_REJECTS];
+	unsigned int nr_rejects;
+
+	/* handles of the pool's own buffers, never ours to close */
+	GSList *owned;
+};
+
+bool
+prime_can_export(struct device *dev)
+{
+	uint64_t cap;
+
+	return !device_get_cap(dev, DRM_CAP_PRIME, &cap) && (cap & DRM_PRIME_CAP_EXPORT);
+}
+
+/* the fd stays ours, the producer must not close it */
+void
+prime_attach(GstBuffer *buffer, int dmabuf, const struct layout *layout)
+{
+	GstStructure *s;
+	char name[16];
+	unsigned int i;
+
+	s = gst_structure_new(PRIME_QDATA, "fd", G_TYPE_INT, dmabuf, NULL);
+
+	for (i = 0; i < layout->planes; i++) {
+		snprintf(name, sizeof(name), "offset%u", i);
+		gst_structure_set(s, name, G_TYPE_INT, layout->offset[i], NULL);
+
+		snprintf(name, sizeof(name), "stride%u", i);
+		gst_structure_set(s, name, G_TYPE_INT, layout->pitch[i], NULL);
+	}
+
+	gst_buffer_set_qdata(buffer, g_quark_from_static_string(PRIME_QDATA), s);
+}
+
+struct prime *
+prime_new(struct device *dev)
+{
+	struct prime *prime;
+	uint64_t cap;
+
+	if (device_get_cap(dev, DRM_CAP_PRIME, &cap) || !(cap & DRM_PRIME_CAP_IMPORT))
+		return NULL;
+
+	prime = g_new0(struct prime, 1);
+	prime->dev = dev;
+	prime->fd = dev->fd;
+	prime->lock = g_mutex_new();
+
+	return prime;
+}
+
+/* unless an entry or the pool still has it */
+static void
+close_handle(struct prime *prime, uint32_t handle)
+{
+	struct drm_gem_close close_req = { .handle = handle };
+	unsigned int i;
+
+	/* the same dma-buf imported with another layout shares the handle */
+	for (i = 0; i < prime->count; i++)
+		if (prime->cache[i].handle == handle)
+			return;
+
+	if (!g_slist_find(prime->owned, GUINT_TO_POINTER(handle)))
+		drmIoctl(prime->fd, DRM_IOCTL_GEM_CLOSE, &close_req);
+}
+
+/* keep is a handle just imported again, it stays open */
+static void
+evict(struct prime *prime, struct import *import, uint32_t keep)
+{
+	uint32_t handle = import->handle;
+
+	if (import->fb)
+		device_rm_fb(prime->dev, import->fb);
+
+	*import = prime->cache[--prime->count];
+
+	if (handle != keep)
+		close_handle(prime, handle);
+}
+
+void
+prime_free(struct prime *prime)
+{
+	while (prime->count)
+		evict(prime, &prime->cache[prime->count - 1], 0);
+
+	g_slist_free(prime->owned);
+	g_mutex_free(prime->lock);
+	g_free(prime);
+}
+
+/* an exported buffer of the pool may come back to us from a producer */
+void
+prime_own(struct prime *prime, uint32_t handle)
+{
+	g_mutex_lock(prime->lock);
+	prime->owned = g_slist_prepend(prime->owned, GUINT_TO_POINTER(handle));
+	g_mutex_unlock(prime->lock);
+}
+
+/* the pool is about to destroy the buffer, drop our framebuffers of it */
+void
+prime_disown(struct prime *prime, uint32_t handle)
+{
+	unsigned int i;
+
+	g_mutex_lock(prime->lock);
+
+	for (i = prime->count; i-- > 0;)
+		if (prime->cache[i].handle == handle)
+			evict(prime, &prime->cache[i], 0);
+
+	prime->owned = g_slist_remove(prime->owned, GUINT_TO_POINTER(handle));
+
+	g_mutex_unlock(prime->lock);
+}
+
+/* the framebuffer prime_import() returned left the screen */
+void
+prime_release(struct prime *prime, uint32_t fb)
+{
+	unsigned int i;
+
+	g_mutex_lock(prime->lock);
+
+	for (i = 0; i < prime->count; i++) {
+		if (prime->cache[i].fb == fb && prime->cache[i].refs) {
+			prime->cache[i].refs--;
+			break;
+		}
+	}
+
+	g_mutex_unlock(prime->lock);
+}
+
+bool
+prime_buffer_fd(GstBuffer *buffer, const struct layout *def,
+		int *dmabuf, struct layout *layout)
+{
+	const GstStructure *s;
+	char name[16];
+	unsigned int i;
+	int value;
+
+	s = gst_buffer_get_qdata(buffer, g_quark_from_static_string(PRIME_QDATA));
+	if (!s || !gst_structure_get_int(s, "fd", dmabuf))
+		return false;
+
+	*layout = *def;
+
+	for (i = 0; i < layout->planes; i++) {
+		snprintf(name, sizeof(name), "offset%u", i);
+		if (gst_structure_get_int(s, name, &value))
+			layout->offset[i] = value;
+
+		snprintf(name, sizeof(name), "stride%u", i);
+		if (gst_structure_get_int(s, name, &value))
+			layout->pitch[i] = value;
+	}
+
+	return true;
+}
+
+/* an fstat() only for an fd number that failed before */
+static bool
+rejected(struct prime *prime, int dmabuf)
+{
+	struct reject *r;
+	struct stat st;
+	unsigned int i;
+	bool stat_done = false;
+
+	for (i = 0; i < prime->nr_rejects; i++) {
+		r = &prime->rejects[i];
+		if (r->fd != dmabuf)
+			continue;
+
+		if (!stat_done && fstat(dmabuf, &st))
+			return false;
+		stat_done = true;
+
+		if (r->dev == st.st_dev && r->ino == st.st_ino) {
+			r->used = ++prime->clock;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void
+reject(struct prime *prime, int dmabuf)
+{
+	struct reject *r = &prime->rejects[0];
+	struct stat st;
+	unsigned int i;
+
+	if (fstat(dmabuf, &st))
+		return;
+
+	if (prime->nr_rejects < PRIME_REJECTS) {
+		r = &prime->rejects[prime->nr_rejects++];
+	} else {
+		for (i = 1; i < PRIME_REJECTS; i++)
+			if (prime->rejects[i].used < r->used)
+				r = &prime->rejects[i];
+	}
+
+	r->fd = dmabuf;
+	r->dev = st.st_dev;
+	r->ino = st.st_ino;
+	r->used = ++prime->clock;
+}
+
+static bool
+import_match(const struct import *import, uint32_t handle, const struct format *format,
+		uint32_t width, uint32_t height, const struct layout *layout)
+{
+	unsigned int i;
+
+	if (import->handle != handle || import->format != format ||
+			import->width != width || import->height != height)
+		return false;
+
+	for (i = 0; i < layout->planes; i++)
+		if (import->offset[i] != layout->offset[i] || import->pitch[i] != layout->pitch[i])
+			return false;
+
+	return true;
+}
+
+uint32_t
+prime_import(struct prime *prime, int dmabuf, const struct format *format,
+		uint32_t width, uint32_t height, const struct layout *layout)
+{
+	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
+	struct import *import, *lru = NULL;
+	uint32_t handle, fb = 0;
+	unsigned int i;
+
+	g_mutex_lock(prime->lock);
+
+	/* a dma-buf the driver refused once is copied from then on */
+	if (rejected(prime, dmabuf))
+		goto out;
+
+	/* one ioctl, no new reference when the handle is already open */
+	if (drmPrimeFDToHandle(prime->fd, dmabuf, &handle)) {
+		perror("failed drmPrimeFDToHandle()");
+		reject(prime, dmabuf);
+		goto out;
+	}
+
+	for (i = 0; i < prime->count; i++) {
+		import = &prime->cache[i];
+
+		if (import_match(import, handle, format, width, height, layout)) {
+			import->used = ++prime->clock;
+			fb = import->fb;
+			if (fb)
+				import->refs++;
+			goto out;
+		}
+
+		if (!import->refs && (!lru || import->used < lru->used))
+			lru = import;
+	}
+
+	if (prime->count == PRIME_CACHE_SIZE) {
+		/* all in flight, this frame is copied rather than one pulled away */
+		if (!lru) {
+			close_handle(prime, handle);
+			goto out;
+		}
+		evict(prime, lru, handle);
+	}
+
+	import = &prime->cache[prime->count];
+	memset(import, 0, sizeof(*import));
+	import->handle = handle;
+
+	for (i = 0; i < layout->planes; i++) {
+		handles[i] = import->handle;
+		pitches[i] = import->pitch[i] = layout->pitch[i];
+		offsets[i] = import->offset[i] = layout->offset[i];
+	}
+
+	/* a rejected buffer stays cached without a framebuffer */
+	if (device_add_fb2(prime->dev, width, height, format->drm_format,
+				handles, pitches, offsets, &import->fb, 0)) {
+		perror("failed drmModeAddFB2(dmabuf)");
+		import->fb = 0;
+	}
+
+	import->format = format;
+	import->width = width;
+	import->height = height;
+	import->used = ++prime->clock;
+	import->refs = import->fb ? 1 : 0;
+	prime->count++;
+	fb = import->fb;
+
+out:
+	g_mutex_unlock(prime->lock);
+
+	return fb;
+}
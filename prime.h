@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef PRIME_H
+#define PRIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <gst/gst.h>
+
+/*
+ * GStreamer 0.10 buffers can't carry a dma-buf, so producers attach a
+ * "dmabuf" structure as buffer qdata: "fd", and optionally "offset0".."2"
+ * and "stride0".."2" when the planes aren't where GStreamer puts them.
+ */
+#define PRIME_QDATA	"dmabuf"
+
+struct device;
+struct format;
+struct layout;
+struct prime;
+
+bool prime_can_export(struct device *dev);
+void prime_attach(GstBuffer *buffer, int dmabuf, const struct layout *layout);
+
+/* one per device, see pool_prime() */
+struct prime *prime_new(struct device *dev);
+void prime_free(struct prime *prime);
+
+/* handles the pool exported: imported like any other, never closed */
+void prime_own(struct prime *prime, uint32_t handle);
+void prime_disown(struct prime *prime, uint32_t handle);
+
+bool prime_buffer_fd(GstBuffer *buffer, const struct layout *def,
+		int *dmabuf, struct layout *layout);
+
+/*
+ * Framebuffer for the dma-buf, 0 when the driver won't take it. It stays
+ * until prime_release(), once the page showing it is free again.
+ */
+uint32_t prime_import(struct prime *prime, int dmabuf, const struct format *format,
+		uint32_t width, uint32_t height, const struct layout *layout);
+void prime_release(struct prime *prime, uint32_t fb);
+
+#endif /* PRIME_H */
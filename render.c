@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "render.h"
+#include "present.h"
+#include "upload.h"
+#include "pool.h"
+#include "prime.h"
+#include "stats.h"
+#include "log.h"
+#include "pacing.h"
+
+#include <stdio.h>
+
+bool
+render_caps_match(struct render *render, GstCaps *caps)
+{
+	GstStructure *structure;
+	int width, height;
+
+	structure = gst_caps_get_structure(caps, 0);
+
+	if (!gst_structure_get_int(structure, "width", &width) ||
+			!gst_structure_get_int(structure, "height", &height))
+		return false;
+
+	return format_from_structure(structure) == render->format &&
+		(uint32_t) width == render->width && (uint32_t) height == render->height;
+}
+
+/* what a buffer of buffer_alloc() needs to give its page back */
+struct upstream_ref {
+	struct render *render;
+	struct page *page;
+	struct pool_buffer *buffer;
+};
+
+/* the free function of the GstBuffer, on whichever thread dropped it last */
+static void
+release_upstream(gpointer data)
+{
+	struct upstream_ref *ref = data;
+	struct render *render = ref->render;
+
+	/* never rendered; the page may be another buffer's after new caps */
+	if (ref->page->buffer == ref->buffer)
+		g_atomic_int_compare_and_exchange(&ref->page->state, PAGE_UPSTREAM, PAGE_FREE);
+
+	g_atomic_int_set(&ref->buffer->upstream, 0);
+
+	if (render->present)
+		present_page_released(render->present);
+
+	gst_object_unref(render->sink);
+	g_slice_free(struct upstream_ref, ref);
+}
+
+/* a free page for upstream to render into, NULL to let it allocate */
+GstBuffer *
+render_buffer_alloc(struct render *render, guint size, GstCaps *caps)
+{
+	struct upstream_ref *ref;
+	struct page *page;
+	GstBuffer *buffer;
+	int dmabuf;
+
+	if (!render->direct || size > render->src_layout.size)
+		return NULL;
+
+	page = present_get_page(render->present);
+	if (!page)
+		return NULL;
+
+	/* the page is held until the last reference to the buffer is gone */
+	ref = g_slice_new(struct upstream_ref);
+	ref->render = render;
+	ref->page = page;
+	ref->buffer = page->buffer;
+	gst_object_ref(render->sink);
+	g_atomic_int_set(&page->buffer->upstream, 1);
+
+	buffer = gst_buffer_new();
+	GST_BUFFER_DATA(buffer) = page->frame + render->layout.offset[0];
+	GST_BUFFER_SIZE(buffer) = size;
+	GST_BUFFER_MALLOCDATA(buffer) = (guint8 *) ref;
+	GST_BUFFER_FREE_FUNC(buffer) = release_upstream;
+	gst_buffer_set_caps(buffer, caps);
+
+	/* for hardware producers that can't write through our mapping */
+	if (render->export && (dmabuf = pool_export(render->pool, page->buffer)) >= 0)
+		prime_attach(buffer, dmabuf, &render->layout);
+
+	return buffer;
+}
+
+/* buffers that may be on screen or written by upstream are kept aside */
+void
+render_retire_ring(struct render *render)
+{
+	unsigned int i;
+
+	for (i = 0; i < render->ring.count; i++) {
+		struct page *page = &render->ring.pages[i];
+
+		if (!page->buffer)
+			continue;
+
+		/* claimed, so buffer_alloc() on another thread can't take it meanwhile */
+		if (ring_claim(page))
+			pool_put(render->pool, page->buffer);
+		else
+			render->retired = g_slist_prepend(render->retired, page->buffer);
+
+		page->buffer = NULL;
+	}
+}
+
+/* a configure that failed half way: the buffers go back, the caps don't match */
+void
+render_put_pages(struct render *render)
+{
+	unsigned int i;
+
+	for (i = 0; i < render->ring.count; i++) {
+		struct page *page = &render->ring.pages[i];
+
+		if (page->buffer)
+			pool_put(render->pool, page->buffer);
+		page->buffer = NULL;
+	}
+
+	render->format = NULL;
+}
+
+/* those upstream still has a buffer of stay, unless all go when stopped */
+void
+render_release_retired(struct render *render, bool all)
+{
+	GSList **l = &render->retired, *link;
+	struct pool_buffer *buffer;
+
+	while ((link = *l)) {
+		buffer = link->data;
+
+		if (!all && g_atomic_int_get(&buffer->upstream)) {
+			l = &link->next;
+			continue;
+		}
+
+		pool_put(render->pool, buffer);
+		*l = g_slist_delete_link(link, link);
+	}
+}
+
+/* drop upstream buffers that are off screen, or all of them when stopped */
+void
+render_release_imports(struct render *render, bool all)
+{
+	unsigned int i;
+
+	for (i = 0; i < RING_MAX_IMPORTS; i++) {
+		struct page *page = &render->ring.imports[i];
+
+		if (page->upstream && (all || g_atomic_int_get(&page->state) == PAGE_FREE)) {
+			prime_release(render->prime, page->fb);
+			gst_buffer_unref(page->upstream);
+			page->upstream = NULL;
+		}
+	}
+}
+
+static bool
+import_pending(struct render *render, GstBuffer *buffer)
+{
+	unsigned int i;
+
+	for (i = 0; i < RING_MAX_IMPORTS; i++)
+		if (render->ring.imports[i].upstream == buffer &&
+				g_atomic_int_get(&render->ring.imports[i].state) != PAGE_FREE)
+			return true;
+
+	return false;
+}
+
+/* framebuffer for an upstream dma-buf, 0 to copy the frame instead */
+static uint32_t
+import_fb(struct render *render, GstBuffer *buffer)
+{
+	struct layout layout;
+	int dmabuf;
+
+	if (!render->prime || !render->import ||
+			!prime_buffer_fd(buffer, &render->src_layout, &dmabuf, &layout))
+		return 0;
+
+	return prime_import(render->prime, dmabuf, render->format,
+			render->width, render->height, &layout);
+}
+
+static void
+copy_frame(struct render *render, struct page *page, GstBuffer *buffer)
+{
+	unsigned int index = page - render->ring.pages;
+	struct upload_job job = {
+		.format = render->format,
+		.convert = render->convert,
+		.src = &render->src_layout,
+		.data = GST_BUFFER_DATA(buffer),
+		.dst = &render->layout,
+		.frame = page->frame,
+		.width = render->width,
+		.height = render->height,
+	};
+
+	if (render->damage) {
+		/* the page may be several frames behind, catch it up */
+		damage_prepare(render->damage, index);
+		job.dirty = render->damage->dirty;
+		job.band = DAMAGE_BAND;
+
+		if (render->use_clips)
+			render->nr_clips[index] = damage_clips(render->damage, render->clips[index],
+					render->x, render->y, render->width);
+		damage_commit(render->damage, index);
+	}
+
+	upload_frame(render->upload, &job);
+}
+
+/* the frame won't make it to the screen */
+static GstFlowReturn
+no_page(struct render *render)
+{
+	trace(TRACE_DROP, render->sink, 0);
+	stats_count(render->stats, STATS_DROPPED);
+
+	return present_failed(render->present) ? GST_FLOW_ERROR : GST_FLOW_WRONG_STATE;
+}
+
+/* target is when the frame is due on screen, 0 for the next vblank */
+GstFlowReturn
+render_frame(struct render *render, GstBuffer *buffer, gint64 target)
+{
+	struct page *page;
+	uint32_t fb;
+	gint64 start, elapsed;
+
+	trace(TRACE_FRAME, render->sink, 0);
+
+	/* the new buffers made it to the screen, the old ones can go */
+	if (render->retired && ring_scanout(&render->ring))
+		render_release_retired(render, false);
+
+	render_release_imports(render, false);
+
+	/* already queued or on screen, e.g. rendered again after preroll */
+	if (import_pending(render, buffer))
+		return GST_FLOW_OK;
+
+	/* upstream rendered straight into one of our pages? */
+	page = ring_find(&render->ring, GST_BUFFER_DATA(buffer) - render->layout.offset[0]);
+
+	if (page) {
+		/* already queued or on screen, e.g. rendered again after preroll */
+		if (g_atomic_int_get(&page->state) != PAGE_UPSTREAM)
+			return GST_FLOW_OK;
+
+		trace(TRACE_IMPORT, render->sink, page->fb);
+
+		if (render->damage) {
+			damage_invalidate(render->damage, page - render->ring.pages);
+			render->nr_clips[page - render->ring.pages] = 0;
+		}
+	} else if ((fb = import_fb(render, buffer))) {
+		page = present_get_import(render->present);
+		if (!page) {
+			prime_release(render->prime, fb);
+			return no_page(render);
+		}
+
+		/* kept alive until it has left the screen */
+		if (page->upstream) {
+			prime_release(render->prime, page->fb);
+			gst_buffer_unref(page->upstream);
+		}
+		page->upstream = gst_buffer_ref(buffer);
+		page->fb = fb;
+
+		trace(TRACE_IMPORT, render->sink, fb);
+
+		if (render->damage)
+			damage_invalidate_shown(render->damage);
+	} else {
+		if (GST_BUFFER_SIZE(buffer) < render->src_layout.size) {
+			fprintf(stderr, "Incoming buffer is less than expected. Some negotiation problem occured...\n");
+			return GST_FLOW_ERROR;
+		}
+
+		/* identical to what is on screen, keep it there */
+		if (render->damage && !damage_scan(render->damage, &render->src_layout, GST_BUFFER_DATA(buffer))) {
+			trace(TRACE_SKIP, render->sink, 0);
+			stats_count(render->stats, STATS_SKIPPED);
+			return GST_FLOW_OK;
+		}
+
+		page = present_get_page(render->present);
+		if (!page)
+			return no_page(render);
+
+		start = g_get_monotonic_time();
+		copy_frame(render, page, buffer);
+		elapsed = g_get_monotonic_time() - start;
+
+		stats_copy(render->stats, render->src_layout.size, elapsed);
+		trace(TRACE_COPY, render->sink, elapsed);
+	}
+
+	/* the presentation thread shows it, we are done with this frame */
+	page->target = target;
+	if (!present_queue(render->present, page)) {
+		ring_set_state(page, PAGE_FREE);
+		stats_count(render->stats, STATS_DROPPED);
+		return GST_FLOW_ERROR;
+	}
+
+	stats_count(render->stats, STATS_RENDERED);
+
+	if (render->paced)
+		pacing_update_delay(render->sink, render->present, &render->render_delay);
+
+	return GST_FLOW_OK;
+}
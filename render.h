@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesink.h>
+
+#include <xf86drmMode.h>
+
+#include "ring.h"
+#include "format.h"
+#include "damage.h"
+
+struct pool;
+struct prime;
+struct stats;
+struct present;
+struct upload;
+
+/*
+ * The way from a GStreamer buffer to a queued page, the same for every
+ * sink with a single ring: upstream wrote into one of our pages, or handed
+ * a dma-buf we can scan out, or the frame is copied into a free page.
+ */
+struct render {
+	GstBaseSink *sink;
+
+	struct pool *pool;
+	struct prime *prime;		/* NULL when not importing */
+	bool export;
+
+	struct stats *stats;
+
+	struct ring ring;
+	/* buffers of a previous ring, until the new one reaches the screen */
+	GSList *retired;
+	struct present *present;
+	struct upload *upload;
+
+	bool paced;
+	gint64 render_delay;	/* usec */
+
+	struct damage *damage;
+	/* per page clips for dirty_fb, the video sits at x, y in the page */
+	bool use_clips;
+	uint32_t x;
+	uint32_t y;
+	drmModeClip clips[RING_MAX_PAGES][DAMAGE_MAX_CLIPS];
+	unsigned int nr_clips[RING_MAX_PAGES];
+
+	/* set by the sink for the caps */
+	const struct format *format;
+	uint32_t width;
+	uint32_t height;
+	bool convert;			/* YUV frames into xRGB pages */
+	bool direct;			/* upstream may write into our pages */
+	bool import;			/* upstream dma-bufs fit the plane */
+	struct layout layout;		/* of our scanout buffers */
+	struct layout src_layout;	/* of upstream buffers */
+};
+
+bool render_caps_match(struct render *render, GstCaps *caps);
+GstBuffer *render_buffer_alloc(struct render *render, guint size, GstCaps *caps);
+GstFlowReturn render_frame(struct render *render, GstBuffer *buffer, gint64 target);
+
+void render_retire_ring(struct render *render);
+void render_put_pages(struct render *render);
+void render_release_retired(struct render *render, bool all);
+void render_release_imports(struct render *render, bool all);
+
+#endif /* RENDER_H */
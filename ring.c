@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "ring.h"
+#include "pool.h"
+
+#include <string.h>
+
+/* imports survive, one of them may still be on screen */
+void ring_init(struct ring *ring, unsigned int count)
+{
+	memset(ring->pages, 0, sizeof(ring->pages));
+	g_atomic_int_set(&ring->next, 0);
+
+	if (count < RING_MIN_PAGES)
+		count = RING_MIN_PAGES;
+	if (count > RING_MAX_PAGES)
+		count = RING_MAX_PAGES;
+
+	ring->count = count;
+}
+
+/* pages are handed out round robin so a free page is reused as late as possible */
+struct page *ring_get_free(struct ring *ring)
+{
+	unsigned int i, n, next = g_atomic_int_get(&ring->next);
+
+	for (i = 0; i < ring->count; i++) {
+		n = (next + i) % ring->count;
+		if (ring_claim(&ring->pages[n])) {
+			g_atomic_int_set(&ring->next, (n + 1) % ring->count);
+			return &ring->pages[n];
+		}
+	}
+
+	return NULL;
+}
+
+struct page *ring_get_import(struct ring *ring)
+{
+	unsigned int i;
+
+	/* a free slot may still hold its upstream buffer, the caller drops it */
+	for (i = 0; i < RING_MAX_IMPORTS; i++)
+		if (ring_claim(&ring->imports[i]))
+			return &ring->imports[i];
+
+	return NULL;
+}
+
+struct page *ring_find(struct ring *ring, const void *frame)
+{
+	unsigned int i;
+
+	for (i = 0; i < ring->count; i++)
+		if (ring->pages[i].frame == frame)
+			return &ring->pages[i];
+
+	return NULL;
+}
+
+struct page *ring_scanout(struct ring *ring)
+{
+	unsigned int i;
+
+	for (i = 0; i < ring->count; i++)
+		if (g_atomic_int_get(&ring->pages[i].state) == PAGE_SCANOUT)
+			return &ring->pages[i];
+
+	for (i = 0; i < RING_MAX_IMPORTS; i++)
+		if (g_atomic_int_get(&ring->imports[i].state) == PAGE_SCANOUT)
+			return &ring->imports[i];
+
+	return NULL;
+}
+
+void ring_set_state(struct page *page, enum page_state state)
+{
+	g_atomic_int_set(&page->state, state);
+}
+
+/*
+ * A free page for the caller alone, as PAGE_UPSTREAM. A page that left the
+ * screen stays out of use while upstream holds a buffer of it: a producer
+ * keeping its last frame must not see it change.
+ */
+bool ring_claim(struct page *page)
+{
+	if (page->buffer && g_atomic_int_get(&page->buffer->upstream))
+		return false;
+
+	return g_atomic_int_compare_and_exchange(&page->state, PAGE_FREE, PAGE_UPSTREAM);
+}
+
+/* the queued page reached the screen, the previous one can be reused */
+void ring_flip_done(struct ring *ring)
+{
+	unsigned int i;
+	struct page *page;
+
+	for (i = 0; i < ring->count + RING_MAX_IMPORTS; i++) {
+		page = i < ring->count ? &ring->pages[i] : &ring->imports[i - ring->count];
+		switch (g_atomic_int_get(&page->state)) {
+		case PAGE_SCANOUT:
+			ring_set_state(page, PAGE_FREE);
+			break;
+		case PAGE_QUEUED:
+			ring_set_state(page, PAGE_SCANOUT);
+			break;
+		default:
+			break;
+		}
+	}
+}
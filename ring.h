@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#define RING_MIN_PAGES	2
+#define RING_MAX_PAGES	8
+#define RING_MAX_IMPORTS	4
+#define RING_MAX_SLOTS	(RING_MAX_PAGES + RING_MAX_IMPORTS)
+
+struct pool_buffer;
+
+/*
+ * buffer_alloc() and render() may run on different threads, with a queue
+ * in between, so a free page is claimed with a compare-and-exchange to
+ * PAGE_UPSTREAM and then belongs to whoever claimed it. Ready, queued and
+ * scanout pages belong to the presentation thread; the state is the
+ * handoff. An upstream page that is never rendered is freed by its GstBuffer.
+ */
+enum page_state {
+	PAGE_FREE,
+	PAGE_UPSTREAM,	/* handed out by buffer_alloc(), not rendered yet */
+	PAGE_READY,	/* rendered, waiting for the presentation thread */
+	PAGE_QUEUED,	/* flip requested, waiting for vblank */
+	PAGE_SCANOUT,	/* currently on screen */
+};
+
+struct page {
+	struct pool_buffer *buffer;
+	unsigned char *frame;
+	uint32_t stride;
+	uint32_t fb;
+	volatile gint state;
+	void *upstream;		/* imported buffer, held until off screen */
+	gint64 queued;		/* monotonic time of present_queue() */
+	gint64 target;		/* monotonic time to show it at, 0 for the next vblank */
+};
+
+struct ring {
+	struct page pages[RING_MAX_PAGES];
+	/* upstream dma-bufs scanned out directly, no buffer of ours */
+	struct page imports[RING_MAX_IMPORTS];
+	unsigned int count;
+	volatile gint next;	/* only a hint where to look first */
+};
+
+void ring_init(struct ring *ring, unsigned int count);
+struct page *ring_get_free(struct ring *ring);
+struct page *ring_get_import(struct ring *ring);
+struct page *ring_find(struct ring *ring, const void *frame);
+struct page *ring_scanout(struct ring *ring);
+void ring_set_state(struct page *page, enum page_state state);
+bool ring_claim(struct page *page);
+void ring_flip_done(struct ring *ring);
+
+#endif /* RING_H */
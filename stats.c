@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Latencies in microseconds: exact below 16, then eight buckets per power
+ * of two, so percentiles are within 12.5%.
+ */
+#define STATS_BUCKETS	256
+
+struct stats {
+	GMutex *lock;
+
+	guint64 counters[NR_STATS_COUNTERS];
+
+	/* current window */
+	gint64 start;
+	guint64 presented;
+	guint64 copy_bytes;
+	gint64 copy_usec;
+	guint32 hist[NR_STATS_STAGES][STATS_BUCKETS];
+};
+
+static const char *stage_names[NR_STATS_STAGES] = {
+	"copy", "flip", "display",
+};
+
+static unsigned int
+bucket(gint64 usec)
+{
+	unsigned int e, b;
+
+	if (usec < 16)
+		return usec < 0 ? 0 : usec;
+
+	e = 63 - __builtin_clzll(usec);
+	b = 16 + (e - 4) * 8 + ((usec >> (e - 3)) & 7);
+
+	return MIN(b, STATS_BUCKETS - 1);
+}
+
+/* lower bound of the bucket */
+static guint64
+bucket_value(unsigned int b)
+{
+	unsigned int e;
+
+	if (b < 16)
+		return b;
+
+	e = (b - 16) / 8 + 4;
+
+	return (guint64) (8 + (b - 16) % 8) << (e - 3);
+}
+
+static guint64
+percentile(const guint32 *hist, unsigned int pct)
+{
+	guint64 total = 0, sum = 0, rank;
+	unsigned int b;
+
+	for (b = 0; b < STATS_BUCKETS; b++)
+		total += hist[b];
+
+	if (!total)
+		return 0;
+
+	rank = (total * pct + 99) / 100;
+
+	for (b = 0; b < STATS_BUCKETS; b++) {
+		sum += hist[b];
+		if (sum >= rank)
+			break;
+	}
+
+	return bucket_value(b);
+}
+
+static void
+reset_window(struct stats *s)
+{
+	s->start = g_get_monotonic_time();
+	s->presented = 0;
+	s->copy_bytes = 0;
+	s->copy_usec = 0;
+	memset(s->hist, 0, sizeof(s->hist));
+}
+
+struct stats *
+stats_new(void)
+{
+	struct stats *s;
+
+	s = g_new0(struct stats, 1);
+	s->lock = g_mutex_new();
+	reset_window(s);
+
+	return s;
+}
+
+void
+stats_free(struct stats *s)
+{
+	g_mutex_free(s->lock);
+	g_free(s);
+}
+
+void
+stats_count(struct stats *s, enum stats_counter counter)
+{
+	g_mutex_lock(s->lock);
+	s->counters[counter]++;
+	if (counter == STATS_PRESENTED)
+		s->presented++;
+	g_mutex_unlock(s->lock);
+}
+
+void
+stats_copy(struct stats *s, size_t bytes, gint64 usec)
+{
+	g_mutex_lock(s->lock);
+	s->copy_bytes += bytes;
+	s->copy_usec += usec;
+	s->hist[STATS_COPY][bucket(usec)]++;
+	g_mutex_unlock(s->lock);
+}
+
+void
+stats_latency(struct stats *s, enum stats_stage stage, gint64 usec)
+{
+	g_mutex_lock(s->lock);
+	s->hist[stage][bucket(usec)]++;
+	g_mutex_unlock(s->lock);
+}
+
+bool
+stats_window_elapsed(struct stats *s, unsigned int msec)
+{
+	bool elapsed;
+
+	g_mutex_lock(s->lock);
+	elapsed = g_get_monotonic_time() - s->start >= (gint64) msec * 1000;
+	g_mutex_unlock(s->lock);
+
+	return elapsed;
+}
+
+GstStructure *
+stats_structure(struct stats *s, const char *name, bool reset)
+{
+	GstStructure *structure;
+	gint64 elapsed;
+	char field[32];
+	unsigned int i;
+
+	g_mutex_lock(s->lock);
+
+	elapsed = MAX(g_get_monotonic_time() - s->start, 1);
+
+	structure = gst_structure_new(name,
+			"rendered", G_TYPE_UINT64, s->counters[STATS_RENDERED],
+			"dropped", G_TYPE_UINT64, s->counters[STATS_DROPPED],
+			"skipped", G_TYPE_UINT64, s->counters[STATS_SKIPPED],
+			"presented", G_TYPE_UINT64, s->counters[STATS_PRESENTED],
+			"fps", G_TYPE_DOUBLE, s->presented * 1e6 / elapsed,
+			"copy-mbps", G_TYPE_DOUBLE, s->copy_usec ? s->copy_bytes / (double) s->copy_usec : 0.0,
+			NULL);
+
+	for (i = 0; i < NR_STATS_STAGES; i++) {
+		snprintf(field, sizeof(field), "%s-p50", stage_names[i]);
+		gst_structure_set(structure, field, G_TYPE_UINT64, percentile(s->hist[i], 50), NULL);
+		snprintf(field, sizeof(field), "%s-p95", stage_names[i]);
+		gst_structure_set(structure, field, G_TYPE_UINT64, percentile(s->hist[i], 95), NULL);
+		snprintf(field, sizeof(field), "%s-p99", stage_names[i]);
+		gst_structure_set(structure, field, G_TYPE_UINT64, percentile(s->hist[i], 99), NULL);
+	}
+
+	if (reset)
+		reset_window(s);
+
+	g_mutex_unlock(s->lock);
+
+	return structure;
+}
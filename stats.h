@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <gst/gst.h>
+
+enum stats_counter {
+	STATS_RENDERED,		/* queued for display */
+	STATS_DROPPED,		/* reached render() but never the screen */
+	STATS_SKIPPED,		/* identical to the frame on screen */
+	STATS_PRESENTED,	/* flip completed */
+	NR_STATS_COUNTERS,
+};
+
+enum stats_stage {
+	STATS_COPY,		/* upload into a scanout buffer */
+	STATS_FLIP,		/* flip, commit or SetPlane ioctl */
+	STATS_DISPLAY,		/* queued until the flip completed */
+	NR_STATS_STAGES,
+};
+
+struct stats;
+
+struct stats *stats_new(void);
+void stats_free(struct stats *s);
+
+void stats_count(struct stats *s, enum stats_counter counter);
+void stats_copy(struct stats *s, size_t bytes, gint64 usec);
+void stats_latency(struct stats *s, enum stats_stage stage, gint64 usec);
+
+/* rates and percentiles cover the window since the last reset */
+bool stats_window_elapsed(struct stats *s, unsigned int msec);
+GstStructure *stats_structure(struct stats *s, const char *name, bool reset);
+
+#endif /* STATS_H */
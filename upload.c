@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#include "upload.h"
+#include "format.h"
+#include "convert.h"
+#include "copy.h"
+
+#include <stdio.h>
+
+#include <glib.h>
+
+#define ROUND_UP(num, scale) (((num) + ((scale) - 1)) & ~((scale) - 1))
+
+struct worker {
+	struct upload *upload;
+	GThread *thread;
+	unsigned int index;
+};
+
+struct upload {
+	unsigned int threads;
+	struct worker workers[UPLOAD_MAX_THREADS];
+
+	GMutex *lock;
+	GCond *start;
+	GCond *done;
+
+	const struct upload_job *job;
+	unsigned int generation;
+	unsigned int pending;
+	uint32_t stripe;
+	bool quit;
+};
+
+static void
+upload_stripe(const struct upload_job *job, uint32_t first, uint32_t last)
+{
+	const struct layout *src = job->src, *dst = job->dst;
+	unsigned int i;
+	uint32_t r0, r1;
+
+	if (first >= last)
+		return;
+
+	if (job->convert) {
+		convert_rows(job->format, src, job->data, job->frame + dst->offset[0],
+				dst->pitch[0], job->width, first, last);
+		return;
+	}
+
+	for (i = 0; i < dst->planes; i++) {
+		uint8_t *d = job->frame + dst->offset[i];
+		const uint8_t *p = job->data + src->offset[i];
+
+		/* subsampled planes have fewer rows than the frame */
+		r0 = (uint64_t) first * dst->rows[i] / job->height;
+		r1 = (uint64_t) last * dst->rows[i] / job->height;
+
+		copy_rows(d + r0 * dst->pitch[i], dst->pitch[i],
+				p + r0 * src->pitch[i], src->pitch[i],
+				dst->row_bytes[i], r1 - r0);
+	}
+}
+
+/* runs of dirty bands only, when the job carries damage */
+static void
+upload_range(const struct upload_job *job, uint32_t first, uint32_t last)
+{
+	uint32_t end;
+
+	if (!job->dirty) {
+		upload_stripe(job, first, last);
+		return;
+	}
+
+	while (first < last) {
+		if (!job->dirty[first / job->band]) {
+			first += job->band;
+			continue;
+		}
+
+		end = first + job->band;
+		while (end < last && job->dirty[end / job->band])
+			end += job->band;
+
+		upload_stripe(job, first, MIN(end, last));
+		first = end;
+	}
+}
+
+static void
+do_stripe(struct upload *u, const struct upload_job *job, unsigned int index)
+{
+	uint32_t first = index * u->stripe;
+	uint32_t last = MIN(first + u->stripe, job->height);
+
+	upload_range(job, MIN(first, job->height), last);
+}
+
+static gpointer
+worker_thread(gpointer data)
+{
+	struct worker *w = data;
+	struct upload *u = w->upload;
+	unsigned int generation = 0;
+	const struct upload_job *job;
+
+	g_mutex_lock(u->lock);
+	while (true) {
+		while (!u->quit && u->generation == generation)
+			g_cond_wait(u->start, u->lock);
+
+		if (u->quit)
+			break;
+
+		generation = u->generation;
+		job = u->job;
+		g_mutex_unlock(u->lock);
+
+		do_stripe(u, job, w->index);
+
+		g_mutex_lock(u->lock);
+		if (--u->pending == 0)
+			g_cond_signal(u->done);
+	}
+	g_mutex_unlock(u->lock);
+
+	return NULL;
+}
+
+struct upload *
+upload_new(unsigned int threads)
+{
+	struct upload *u;
+	unsigned int i;
+
+	u = g_new0(struct upload, 1);
+
+	u->threads = CLAMP(threads, 1, UPLOAD_MAX_THREADS);
+	u->lock = g_mutex_new();
+	u->start = g_cond_new();
+	u->done = g_cond_new();
+
+	/* the calling thread takes stripe 0 */
+	for (i = 1; i < u->threads; i++) {
+		struct worker *w = &u->workers[i];
+
+		w->upload = u;
+		w->index = i;
+		w->thread = g_thread_create(worker_thread, w, TRUE, NULL);
+		if (!w->thread) {
+			fprintf(stderr, "failed to create upload thread\n");
+			break;
+		}
+	}
+
+	u->threads = i;
+
+	return u;
+}
+
+void
+upload_free(struct upload *u)
+{
+	unsigned int i;
+
+	g_mutex_lock(u->lock);
+	u->quit = true;
+	g_cond_broadcast(u->start);
+	g_mutex_unlock(u->lock);
+
+	for (i = 1; i < u->threads; i++)
+		g_thread_join(u->workers[i].thread);
+
+	g_cond_free(u->done);
+	g_cond_free(u->start);
+	g_mutex_free(u->lock);
+	g_free(u);
+}
+
+void
+upload_frame(struct upload *u, const struct upload_job *job)
+{
+	if (!u || u->threads == 1) {
+		upload_range(job, 0, job->height);
+		return;
+	}
+
+	/* even stripes keep 4:2:0 chroma rows in one piece */
+	g_mutex_lock(u->lock);
+	u->job = job;
+	u->stripe = ROUND_UP((job->height + u->threads - 1) / u->threads, 2);
+	u->pending = u->threads - 1;
+	u->generation++;
+	g_cond_broadcast(u->start);
+	g_mutex_unlock(u->lock);
+
+	do_stripe(u, job, 0);
+
+	g_mutex_lock(u->lock);
+	while (u->pending)
+		g_cond_wait(u->done, u->lock);
+	g_mutex_unlock(u->lock);
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2012 matsi
+ *
+ * This file may be used under the terms of the GNU Lesser General Public
+ * License version 2.1, a copy of which is found in LICENSE included in the
+ * packaging of this file.
+ */
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define UPLOAD_MAX_THREADS	16
+
+struct format;
+struct layout;
+struct upload;
+
+/* one frame from an upstream buffer into a scanout buffer */
+struct upload_job {
+	const struct format *format;
+	bool convert;		/* YUV source, xRGB destination */
+	const struct layout *src;
+	const uint8_t *data;
+	const struct layout *dst;
+	uint8_t *frame;
+	uint32_t width;
+	uint32_t height;
+	const uint8_t *dirty;	/* bands of band rows to upload, NULL for all */
+	uint32_t band;		/* even, so stripes never split a band */
+};
+
+struct upload *upload_new(unsigned int threads);
+void upload_free(struct upload *u);
+
+/* splits the frame in horizontal stripes, returns when all are done */
+void upload_frame(struct upload *u, const struct upload_job *job);
+
+#endif /* UPLOAD_H */